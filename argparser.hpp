@@ -1,21 +1,145 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <optional>
-#include <sstream>
 #include <string>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace argparse
 {
+    // Integer in decimal, or in hex, octal or binary with a 0x / 0o / 0b prefix. Nothing is
+    // guessed: "10" is ten and "ff" is an error.
+    template <typename T>
+    std::optional<T> parse_integer(std::string_view s)
+    {
+        static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool>);
+        bool negative = false;
+        if constexpr (std::is_signed_v<T>)
+        {
+            if (!s.empty() && s.front() == '-')
+            {
+                negative = true;
+                s.remove_prefix(1);
+            }
+        }
+        int base = 10;
+        if (s.size() > 2 && s[0] == '0')
+        {
+            switch (s[1])
+            {
+            case 'x':
+            case 'X':
+                base = 16;
+                break;
+            case 'o':
+            case 'O':
+                base = 8;
+                break;
+            case 'b':
+            case 'B':
+                base = 2;
+                break;
+            }
+            if (base != 10)
+                s.remove_prefix(2);
+        }
+        unsigned long long magnitude = 0;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), magnitude, base);
+        if (s.empty() || ec != std::errc() || ptr != s.data() + s.size())
+            return std::nullopt;
+        using U = std::make_unsigned_t<T>;
+        const unsigned long long limit = static_cast<U>(std::numeric_limits<T>::max()) + (negative ? 1ULL : 0ULL);
+        if (magnitude > limit)
+            return std::nullopt;
+        return static_cast<T>(negative ? static_cast<U>(0ULL - magnitude) : static_cast<U>(magnitude));
+    }
+
+    template <typename T>
+    std::optional<T> parse_floating(std::string_view s)
+    {
+        T value{};
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (s.empty() || ec != std::errc() || ptr != s.data() + s.size())
+            return std::nullopt;
+        return value;
+    }
+
+    // An integer (see parse_integer) with an optional binary K / M / G / T suffix, or with an 's'
+    // suffix counting sectors of sector_size bytes, which is refused while sector_size is 0.
+    inline std::optional<unsigned long long> parse_size(std::string_view s, unsigned long long sector_size = 0)
+    {
+        unsigned long long scale = 1;
+        if (!s.empty())
+        {
+            switch (s.back())
+            {
+            case 'k':
+            case 'K':
+                scale = 1ULL << 10;
+                break;
+            case 'm':
+            case 'M':
+                scale = 1ULL << 20;
+                break;
+            case 'g':
+            case 'G':
+                scale = 1ULL << 30;
+                break;
+            case 't':
+            case 'T':
+                scale = 1ULL << 40;
+                break;
+            case 's':
+            case 'S':
+                if (sector_size == 0)
+                    return std::nullopt;
+                scale = sector_size;
+                break;
+            default:
+                scale = 0; // no suffix
+                break;
+            }
+            if (scale != 0)
+                s.remove_suffix(1);
+            else
+                scale = 1;
+        }
+        auto value = parse_integer<unsigned long long>(s);
+        if (!value || *value > std::numeric_limits<unsigned long long>::max() / scale)
+            return std::nullopt;
+        return *value * scale;
+    }
+
+    // Non-empty fields of a delimited list.
+    inline std::vector<std::string> split_list(std::string_view list, char delimiter = ',')
+    {
+        std::vector<std::string> tokens;
+        while (!list.empty())
+        {
+            size_t end = std::min(list.find(delimiter), list.size());
+            if (end > 0)
+                tokens.emplace_back(list.substr(0, end));
+            list.remove_prefix(std::min(end + 1, list.size()));
+        }
+        return tokens;
+    }
+
     class ArgParser
     {
     private:
+        // A value as get<T> last parsed it, so repeated lookups neither parse nor allocate.
+        using Cache = std::variant<std::monostate, std::optional<long long>, std::optional<unsigned long long>, std::optional<double>>;
+
         // Option structure for named arguments
         struct Option
         {
@@ -26,6 +150,13 @@ namespace argparse
             std::optional<std::string> value;
             bool required;
             bool is_flag; // True if it's a flag, false if it's an option with a value
+            mutable Cache cached{};
+        };
+        // Lets option_map_ be searched with a string_view.
+        struct NameHash
+        {
+            using is_transparent = void;
+            size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
         };
         // Positional argument structure
         struct Positional
@@ -35,6 +166,7 @@ namespace argparse
             bool required;
             std::optional<std::string> value;
             std::optional<std::string> default_value;
+            mutable Cache cached{};
         };
 
     public:
@@ -47,9 +179,9 @@ namespace argparse
             size_t index = options_.size();
             options_.push_back({long_name, short_name, help, default_value.empty() ? std::nullopt : std::make_optional(default_value), std::nullopt, required, false});
             if (!long_name.empty())
-                option_map_[strip(long_name)] = index;
+                option_map_[std::string(strip(long_name))] = index;
             if (!short_name.empty())
-                option_map_[strip(short_name)] = index;
+                option_map_[std::string(strip(short_name))] = index;
         }
 
         void add_flag(const std::string &long_name, const std::string &short_name = "", const std::string &help = "")
@@ -57,9 +189,9 @@ namespace argparse
             size_t index = options_.size();
             options_.push_back({long_name, short_name, help, std::nullopt, std::nullopt, false, true});
             if (!long_name.empty())
-                option_map_[strip(long_name)] = index;
+                option_map_[std::string(strip(long_name))] = index;
             if (!short_name.empty())
-                option_map_[strip(short_name)] = index;
+                option_map_[std::string(strip(short_name))] = index;
         }
 
         // Add a positional argument with optional help, required flag, and default value
@@ -71,6 +203,19 @@ namespace argparse
         // Parse command line arguments. Returns true if parsing is successful, false otherwise.
         bool parse(int argc, char *argv[])
         {
+            // Parsing again (a reloaded configuration) starts from scratch.
+            for (auto &opt : options_)
+            {
+                opt.value.reset();
+                opt.cached = {};
+            }
+            for (auto &pos : positional_defs_)
+            {
+                pos.value.reset();
+                pos.cached = {};
+            }
+            positional_args_.clear();
+
             size_t pos_idx = 0;
             for (int i = 1; i < argc; ++i)
             {
@@ -172,99 +317,56 @@ namespace argparse
             return true;
         }
 
+        // Typed value of an option. Integers are read by parse_integer, so 0x / 0o / 0b select the
+        // base; bools accept true/false/1/0. The parsed value is cached in the option, which makes
+        // get<T> allocation free but not safe to call from several threads at once.
         template <typename T>
-        std::optional<T> get(const std::string &name) const
+        std::optional<T> get(std::string_view name) const
         {
-            auto value_str_opt = get(name); // Calls the std::string version
-            if (!value_str_opt)
-            {
+            const Option *opt = find(name);
+            if (!opt || !opt->value)
                 return std::nullopt;
-            }
-
-            const std::string &value_str = *value_str_opt;
-            T val;
+            return typed<T>(*opt->value, opt->cached);
+        }
 
-            if constexpr (std::is_same_v<T, bool>)
-            {
-                std::string lower_str = value_str;
-                std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(),
-                               [](unsigned char c)
-                               { return std::tolower(c); });
-                if (lower_str == "true" || lower_str == "1")
-                    return true;
-                if (lower_str == "false" || lower_str == "0")
-                    return false;
-                return std::nullopt;
-            }
-            else
-            {
-                std::istringstream iss(value_str);
-                if constexpr (std::is_integral_v<T>)
-                {
-                    // Check for hex prefix or hex characters
-                    bool is_hex = value_str.starts_with("0x") || value_str.starts_with("0X") ||
-                                  std::any_of(value_str.begin(), value_str.end(),
-                                              [](char c)
-                                              { return (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); });
-
-                    if (is_hex)
-                        iss >> std::hex >> val;
-                    else
-                        iss >> val;
-                }
-                else
-                { // Floating point or other non-bool, non-integral types
-                    iss >> val;
-                }
+        // Byte count of an option (see parse_size).
+        std::optional<unsigned long long> get_size(std::string_view name, unsigned long long sector_size = 0) const
+        {
+            auto value = get_view(name);
+            return value ? parse_size(*value, sector_size) : std::nullopt;
+        }
 
-                if (iss.fail() || iss.peek() != EOF)
-                {
-                    return std::nullopt;
-                }
-                return val;
-            }
+        // The option's value as stored; valid until the next parse().
+        std::optional<std::string_view> get_view(std::string_view name) const
+        {
+            const Option *opt = find(name);
+            if (opt && opt->value)
+                return std::string_view(*opt->value);
+            return std::nullopt;
         }
 
-        std::optional<std::string> get(const std::string &name) const
+        std::optional<std::string> get(std::string_view name) const
         {
-            auto it = option_map_.find(name);
-            if (it != option_map_.end())
-            {
-                const auto &opt = options_[it->second];
-                if (opt.value.has_value())
-                    return opt.value;
-            }
+            auto value = get_view(name);
+            if (value)
+                return std::string(*value);
             return std::nullopt;
         }
 
-        std::optional<std::vector<std::string>> get_list(const std::string &name, char delimiter = ',') const
+        std::optional<std::vector<std::string>> get_list(std::string_view name, char delimiter = ',') const
         {
-            auto value_opt = get(name);
-            if (!value_opt)
+            auto value = get_view(name);
+            if (!value)
             {
                 return std::nullopt;
             }
-            std::vector<std::string> tokens;
-            std::string token;
-            std::istringstream tokenStream(*value_opt);
-            while (std::getline(tokenStream, token, delimiter))
-            {
-                if (!token.empty())
-                {
-                    tokens.push_back(token);
-                }
-            }
-            return tokens;
+            return split_list(*value, delimiter);
         }
 
-        bool is_set(const std::string &name) const
+        bool is_set(std::string_view name) const
         {
-            auto it = option_map_.find(name);
-            if (it != option_map_.end())
-            {
-                return options_[it->second].value.has_value();
-            }
-            return false;
+            const Option *opt = find(name);
+            return opt && opt->value.has_value();
         }
 
         const std::vector<std::string> &positional() const
@@ -273,21 +375,59 @@ namespace argparse
         }
 
         // Get positional argument value by name (returns default if not set)
-        std::optional<std::string> get_positional(const std::string &name) const
+        std::optional<std::string> get_positional(std::string_view name) const
+        {
+            auto value = get_positional_view(name);
+            if (value)
+                return std::string(*value);
+            return std::nullopt;
+        }
+
+        std::optional<std::string_view> get_positional_view(std::string_view name) const
         {
             for (const auto &pos : positional_defs_)
             {
                 if (pos.name == name)
                 {
                     if (pos.value.has_value())
-                        return pos.value;
+                        return std::string_view(*pos.value);
                     if (pos.default_value.has_value())
-                        return pos.default_value;
+                        return std::string_view(*pos.default_value);
                 }
             }
             return std::nullopt;
         }
 
+        // Access by registration index (add_option / add_flag and add_positional each count from
+        // 0), for callers that resolved the index already, such as Args.
+        template <typename T>
+        std::optional<T> get_at(size_t index) const
+        {
+            const Option &opt = options_[index];
+            return opt.value ? typed<T>(*opt.value, opt.cached) : std::nullopt;
+        }
+
+        std::optional<std::string_view> get_view_at(size_t index) const
+        {
+            const Option &opt = options_[index];
+            return opt.value ? std::optional<std::string_view>(*opt.value) : std::nullopt;
+        }
+
+        bool is_set_at(size_t index) const { return options_[index].value.has_value(); }
+
+        template <typename T>
+        std::optional<T> get_positional_at(size_t index) const
+        {
+            const Positional &pos = positional_defs_[index];
+            return pos.value ? typed<T>(*pos.value, pos.cached) : std::nullopt;
+        }
+
+        std::optional<std::string_view> get_positional_view_at(size_t index) const
+        {
+            const Positional &pos = positional_defs_[index];
+            return pos.value ? std::optional<std::string_view>(*pos.value) : std::nullopt;
+        }
+
         // Print help message for usage and arguments
         void print_help(const std::string &prog_name) const
         {
@@ -349,19 +489,270 @@ namespace argparse
         }
 
     private:
-        static std::string strip(std::string_view s)
+        template <typename T>
+        static std::optional<T> typed(std::string_view value, Cache &cache)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                auto is = [&](std::string_view word)
+                {
+                    return std::equal(value.begin(), value.end(), word.begin(), word.end(), [](char a, char b)
+                                      { return std::tolower(static_cast<unsigned char>(a)) == b; });
+                };
+                if (is("true") || is("1"))
+                    return true;
+                if (is("false") || is("0"))
+                    return false;
+                return std::nullopt;
+            }
+            else
+            {
+                using Parsed = std::conditional_t<std::is_floating_point_v<T>, double,
+                                                  std::conditional_t<std::is_signed_v<T>, long long, unsigned long long>>;
+                auto *slot = std::get_if<std::optional<Parsed>>(&cache);
+                if (!slot)
+                {
+                    if constexpr (std::is_floating_point_v<T>)
+                        cache = parse_floating<double>(value);
+                    else
+                        cache = parse_integer<Parsed>(value);
+                    slot = std::get_if<std::optional<Parsed>>(&cache);
+                }
+                if (!*slot)
+                    return std::nullopt;
+                if constexpr (std::is_floating_point_v<T>)
+                    return static_cast<T>(**slot);
+                else
+                {
+                    if (!std::in_range<T>(**slot))
+                        return std::nullopt;
+                    return static_cast<T>(**slot);
+                }
+            }
+        }
+
+        static constexpr std::string_view strip(std::string_view s)
         {
             if (s.rfind("--", 0) == 0)
-                return std::string(s.substr(2));
+                return s.substr(2);
             if (s.rfind("-", 0) == 0)
-                return std::string(s.substr(1));
-            return std::string(s);
+                return s.substr(1);
+            return s;
+        }
+
+        const Option *find(std::string_view name) const
+        {
+            auto it = option_map_.find(name);
+            return it != option_map_.end() ? &options_[it->second] : nullptr;
         }
 
         std::string description_;
         std::vector<Option> options_;
-        std::unordered_map<std::string, size_t> option_map_;
+        std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> option_map_;
         std::vector<Positional> positional_defs_;
         std::vector<std::string> positional_args_;
     };
-}
\ No newline at end of file
+
+    // Compile-time option schema: the options of a tool declared once as a constant array,
+    //
+    //     inline constexpr argparse::Spec copy_options[] = {
+    //         argparse::positional("source", "Source file or device path.", true),
+    //         argparse::option("--thread", "-T", "thread count", false, "5"),
+    //         argparse::flag("--test", "", "for test"),
+    //     };
+    //     argparse::Args<copy_options> args("Copy and Compare test.");
+    //     ... args.get<"thread", int>() ...
+    //
+    // Names resolve to indices at compile time, so every access is an array index and a misspelled
+    // or duplicated name does not compile. Parsing and help are ArgParser's.
+    struct Spec
+    {
+        enum class Kind
+        {
+            Option,
+            Flag,
+            Positional
+        };
+        Kind kind;
+        std::string_view long_name; // the name, for a positional
+        std::string_view short_name;
+        std::string_view help;
+        bool required;
+        std::string_view default_value;
+    };
+
+    constexpr Spec option(std::string_view long_name, std::string_view short_name = "", std::string_view help = "", bool required = false, std::string_view default_value = "")
+    {
+        return {Spec::Kind::Option, long_name, short_name, help, required, default_value};
+    }
+
+    constexpr Spec flag(std::string_view long_name, std::string_view short_name = "", std::string_view help = "")
+    {
+        return {Spec::Kind::Flag, long_name, short_name, help, false, {}};
+    }
+
+    constexpr Spec positional(std::string_view name, std::string_view help = "", bool required = false, std::string_view default_value = "")
+    {
+        return {Spec::Kind::Positional, name, {}, help, required, default_value};
+    }
+
+    // A string literal as a template argument, as in get<"thread", int>().
+    template <size_t N>
+    struct Name
+    {
+        char chars[N];
+        constexpr Name(const char (&s)[N]) { std::copy_n(s, N, chars); }
+        constexpr std::string_view view() const { return {chars, N - 1}; }
+    };
+
+    namespace schema_detail
+    {
+        constexpr std::string_view strip(std::string_view s)
+        {
+            if (s.starts_with("--"))
+                return s.substr(2);
+            if (s.starts_with("-"))
+                return s.substr(1);
+            return s;
+        }
+
+        // How get<> refers to a spec: an option's long or short name without dashes, or a
+        // positional's name.
+        constexpr bool matches(const Spec &spec, std::string_view name)
+        {
+            if (spec.kind == Spec::Kind::Positional)
+                return spec.long_name == name;
+            return (!spec.long_name.empty() && strip(spec.long_name) == name) ||
+                   (!spec.short_name.empty() && strip(spec.short_name) == name);
+        }
+
+        template <const auto &Schema>
+        constexpr const Spec *find(std::string_view name)
+        {
+            for (const Spec &spec : Schema)
+            {
+                if (matches(spec, name))
+                    return &spec;
+            }
+            return nullptr;
+        }
+
+        // Position of name in ArgParser's registration order: options and flags share one
+        // sequence, positionals have their own.
+        template <const auto &Schema>
+        constexpr size_t index_of(std::string_view name)
+        {
+            size_t options = 0, positionals = 0;
+            for (const Spec &spec : Schema)
+            {
+                const bool pos = spec.kind == Spec::Kind::Positional;
+                if (matches(spec, name))
+                    return pos ? positionals : options;
+                ++(pos ? positionals : options);
+            }
+            return 0;
+        }
+
+        template <const auto &Schema>
+        constexpr bool unique_names()
+        {
+            for (const Spec &spec : Schema)
+            {
+                for (std::string_view name : {spec.kind == Spec::Kind::Positional ? spec.long_name : strip(spec.long_name), strip(spec.short_name)})
+                {
+                    if (name.empty())
+                        continue;
+                    size_t hits = 0;
+                    for (const Spec &other : Schema)
+                        hits += matches(other, name) ? 1 : 0;
+                    if (hits != 1)
+                        return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    template <const auto &Schema>
+    class Args
+    {
+        static_assert(schema_detail::unique_names<Schema>(), "argparse::Args: two entries of the schema share a name");
+
+    public:
+        explicit Args(const std::string &desc = "") : parser_(desc)
+        {
+            for (const Spec &spec : Schema)
+            {
+                switch (spec.kind)
+                {
+                case Spec::Kind::Option:
+                    parser_.add_option(std::string(spec.long_name), std::string(spec.short_name), std::string(spec.help), spec.required,
+                                       std::string(spec.default_value));
+                    break;
+                case Spec::Kind::Flag:
+                    parser_.add_flag(std::string(spec.long_name), std::string(spec.short_name), std::string(spec.help));
+                    break;
+                case Spec::Kind::Positional:
+                    parser_.add_positional(std::string(spec.long_name), std::string(spec.help), spec.required, std::string(spec.default_value));
+                    break;
+                }
+            }
+        }
+
+        bool parse(int argc, char *argv[]) { return parser_.parse(argc, argv); }
+
+        // The raw value as std::string_view (the default) or std::string, otherwise as
+        // ArgParser::get<T> reads it.
+        template <Name N, typename T = std::string_view>
+        std::optional<T> get() const
+        {
+            constexpr const Spec *spec = schema_detail::find<Schema>(N.view());
+            static_assert(spec != nullptr, "argparse::Args: the schema has no entry of this name");
+            constexpr size_t index = schema_detail::index_of<Schema>(N.view());
+            constexpr bool pos = spec && spec->kind == Spec::Kind::Positional;
+
+            if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>)
+            {
+                auto value = pos ? parser_.get_positional_view_at(index) : parser_.get_view_at(index);
+                if (!value)
+                    return std::nullopt;
+                return T(*value);
+            }
+            else if constexpr (pos)
+                return parser_.template get_positional_at<T>(index);
+            else
+                return parser_.template get_at<T>(index);
+        }
+
+        template <Name N>
+        bool is_set() const
+        {
+            return get<N>().has_value();
+        }
+
+        // Byte count (see parse_size).
+        template <Name N>
+        std::optional<unsigned long long> get_size(unsigned long long sector_size = 0) const
+        {
+            auto value = get<N>();
+            return value ? parse_size(*value, sector_size) : std::nullopt;
+        }
+
+        template <Name N>
+        std::optional<std::vector<std::string>> get_list(char delimiter = ',') const
+        {
+            auto value = get<N>();
+            if (!value)
+                return std::nullopt;
+            return split_list(*value, delimiter);
+        }
+
+        // Arguments beyond the declared positionals.
+        const std::vector<std::string> &positional() const { return parser_.positional(); }
+
+        void print_help(const std::string &prog_name) const { parser_.print_help(prog_name); }
+
+    private:
+        ArgParser parser_;
+    };
+}
@@ -0,0 +1,75 @@
+// Cost of ArgParser: parsing a typical diskrw-sized command line, and reading values back by name
+// (first get converts, later ones hit the cache) and through the compile-time schema.
+// Usage: argparser_bench [iterations] [--json]
+#include "../argparser.hpp"
+#include "bench.hpp"
+#include <string>
+#include <vector>
+
+using namespace argparse;
+
+inline constexpr Spec bench_options[] = {
+    positional("mode", "r or w", true),
+    positional("disk", "disk", true),
+    option("--block-size", "-b", "bytes per request", false, "4K"),
+    option("--queue-depth", "-q", "requests in flight", false, "32"),
+    option("--threads", "-T", "worker threads", false, "1"),
+    option("--time", "", "seconds to run", false, "10"),
+    option("--offset", "-o", "start offset", false, "0"),
+    option("--log", "-L", "log level", false, "INFO"),
+    flag("--random", "", "random offsets"),
+    flag("--verify", "", "check the data read"),
+};
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("argparser", argc, argv);
+    const size_t iterations = report.number(0, 200000);
+    report.context("iterations", std::to_string(iterations));
+
+    std::vector<std::string> words = {"bench", "r", "/dev/nvme0n1", "-b", "128K", "--queue-depth=64", "-T", "4",
+                                      "--time", "30", "-o", "0x100000", "--random", "--log", "WARNING"};
+    std::vector<char *> args;
+    for (auto &w : words)
+        args.push_back(w.data());
+    const int count = static_cast<int>(args.size());
+
+    ArgParser parser("bench");
+    for (const Spec &spec : bench_options)
+    {
+        if (spec.kind == Spec::Kind::Positional)
+            parser.add_positional(std::string(spec.long_name), std::string(spec.help), spec.required);
+        else if (spec.kind == Spec::Kind::Flag)
+            parser.add_flag(std::string(spec.long_name), std::string(spec.short_name), std::string(spec.help));
+        else
+            parser.add_option(std::string(spec.long_name), std::string(spec.short_name), std::string(spec.help), spec.required,
+                              std::string(spec.default_value));
+    }
+    Args<bench_options> schema("bench");
+
+    double parse_ns = ns_per_call(iterations, [&](size_t)
+                                  { keep(parser.parse(count, args.data())); });
+
+    // Reparsing drops the cached conversions, so every round pays for the first get.
+    double first_get_ns = ns_per_call(iterations, [&](size_t)
+                                      {
+        parser.parse(count, args.data());
+        keep(parser.get<int>("--queue-depth")); });
+    parser.parse(count, args.data());
+    double cached_get_ns = ns_per_call(iterations * 10, [&](size_t)
+                                       { keep(parser.get<int>("--queue-depth")); });
+    double size_ns = ns_per_call(iterations * 10, [&](size_t)
+                                 { keep(parser.get_size("--block-size")); });
+
+    schema.parse(count, args.data());
+    double schema_ns = ns_per_call(iterations * 10, [&](size_t)
+                                   { keep(schema.get<"queue-depth", int>()); });
+
+    report.add("parse (15 words)", parse_ns, "ns/parse");
+    report.add("parse + first get<int>", first_get_ns, "ns");
+    report.add("get<int> cached", cached_get_ns, "ns/get");
+    report.add("get_size", size_ns, "ns/get");
+    report.add("Args::get<int> (schema)", schema_ns, "ns/get");
+    report.print();
+    return 0;
+}
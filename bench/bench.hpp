@@ -0,0 +1,130 @@
+// Shared timing and reporting for the microbenchmarks. Results print as a table, or with --json
+// as one JSON object per program so that bench/run.sh can collect them and runs from different
+// releases can be diffed.
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class BenchReport
+{
+public:
+    // Takes --json out of the arguments; the rest are available through arg() and number().
+    BenchReport(std::string name, int argc, char *argv[]) : name_(std::move(name))
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::string_view(argv[i]) == "--json")
+                json_ = true;
+            else
+                args_.push_back(argv[i]);
+        }
+    }
+
+    // Positional argument i, or fallback when it was not given.
+    std::string arg(size_t i, std::string fallback) const { return i < args_.size() ? args_[i] : fallback; }
+    unsigned long long number(size_t i, unsigned long long fallback) const { return i < args_.size() ? std::stoull(args_[i]) : fallback; }
+
+    // Describes the run (sizes, kernel, ...); printed as a header line or a "context" member.
+    void context(std::string key, std::string value) { context_.emplace_back(std::move(key), std::move(value)); }
+
+    void add(std::string metric, double value, std::string unit) { results_.push_back({std::move(metric), value, std::move(unit)}); }
+
+    void print() const
+    {
+        if (!json_)
+        {
+            std::string header;
+            for (const auto &[key, value] : context_)
+                header += (header.empty() ? "" : ", ") + key + " " + value;
+            printf("%s%s%s\n", name_.c_str(), header.empty() ? "" : ": ", header.c_str());
+            for (const Result &r : results_)
+                printf("  %-32s %12.2f %s\n", r.metric.c_str(), r.value, r.unit.c_str());
+            return;
+        }
+        std::string out = "{\"bench\":" + quote(name_) + ",\"context\":{";
+        for (size_t i = 0; i < context_.size(); ++i)
+            out += (i ? "," : "") + quote(context_[i].first) + ":" + quote(context_[i].second);
+        out += "},\"results\":[";
+        for (size_t i = 0; i < results_.size(); ++i)
+        {
+            char value[64];
+            snprintf(value, sizeof(value), "%.6g", results_[i].value);
+            out += (i ? "," : "") + std::string("{\"metric\":") + quote(results_[i].metric) + ",\"value\":" + value +
+                   ",\"unit\":" + quote(results_[i].unit) + "}";
+        }
+        out += "]}";
+        printf("%s\n", out.c_str());
+    }
+
+private:
+    struct Result
+    {
+        std::string metric;
+        double value;
+        std::string unit;
+    };
+
+    static std::string quote(std::string_view s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    std::string name_;
+    bool json_ = false;
+    std::vector<std::string> args_;
+    std::vector<std::pair<std::string, std::string>> context_;
+    std::vector<Result> results_;
+};
+
+// Runs fn iterations times after iterations / 10 warm-up calls and returns ns per call. fn gets
+// the iteration number.
+template <typename Fn>
+double ns_per_call(size_t iterations, Fn &&fn)
+{
+    for (size_t i = 0; i < iterations / 10; ++i)
+        fn(i);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        fn(i);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+// Keeps a result alive so the optimizer cannot drop the work that produced it.
+template <typename T>
+inline void keep(const T &value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const T *volatile sink;
+    sink = &value;
+#endif
+}
+
+#endif // BENCH_HPP
@@ -0,0 +1,43 @@
+// Throughput of first_mismatch() against std::memcmp on equal buffers (the common case in the
+// copy and compare test), plus the cost of locating a difference near the end.
+// Usage: compare_bench [KiB] [iterations] [--json]
+#include "../compare.hpp"
+#include "bench.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("compare", argc, argv);
+    const size_t size = report.number(0, 4096) * 1024; // KiB
+    const size_t iterations = report.number(1, 200);
+    report.context("buffer", std::to_string(size / 1024) + " KiB");
+    report.context("kernel", compare_kernel());
+
+    std::vector<char> a(size), b(size);
+    for (size_t i = 0; i < size; ++i)
+        a[i] = b[i] = static_cast<char>(i * 131 + 7);
+
+    auto gb_per_sec = [&](auto &&fn)
+    { return static_cast<double>(size) / ns_per_call(iterations, fn); };
+
+    double memcmp_gbs = gb_per_sec([&](size_t)
+                                   { keep(std::memcmp(a.data(), b.data(), size)); });
+    double kernel_gbs = gb_per_sec([&](size_t)
+                                   { keep(first_mismatch(a.data(), b.data(), size)); });
+    double scalar_gbs = gb_per_sec([&](size_t)
+                                   { keep(compare_detail::scalar(reinterpret_cast<const unsigned char *>(a.data()),
+                                                                 reinterpret_cast<const unsigned char *>(b.data()), 0, size)); });
+
+    b[size - 100] ^= 1;
+    double locate_gbs = gb_per_sec([&](size_t)
+                                   { keep(first_mismatch(a.data(), b.data(), size)); });
+
+    report.add("std::memcmp", memcmp_gbs, "GB/s");
+    report.add("first_mismatch", kernel_gbs, "GB/s");
+    report.add("scalar (u64 words)", scalar_gbs, "GB/s");
+    report.add("locate near end", locate_gbs, "GB/s");
+    report.print();
+    return 0;
+}
@@ -0,0 +1,81 @@
+// IoEngine on a file or device: random block reads at queue depth 1 and 32, reporting IOPS and
+// latency percentiles. Without a path a scratch file is written first (reads of it are O_DIRECT /
+// unbuffered, so they still reach the disk); a device is only ever read.
+// Usage: diskrw_bench [file|device] [seconds] [block KiB] [--json]
+#include "../diskrw.hpp"
+#include "bench.hpp"
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("diskrw", argc, argv);
+    const std::string target = report.arg(0, "");
+    const unsigned long long seconds = report.number(1, 3);
+    const size_t block = report.number(2, 4) * 1024;
+    const std::string path = target.empty() ? "diskrw_bench.bin" : disk_path(target);
+
+    if (target.empty())
+    {
+        blockio::Handle out = blockio::open_file(path, blockio::create);
+        blockio::AlignedBuffer chunk(1 << 20);
+        for (size_t i = 0; i < chunk.size(); ++i)
+            chunk.data()[i] = static_cast<char>(i * 131 + 7);
+        for (unsigned long long at = 0; at < (256ULL << 20); at += chunk.size())
+            blockio::write_full_at(out, chunk.data(), chunk.size(), at);
+    }
+
+    int rc = 0;
+    try
+    {
+        Device device(path, false);
+        const unsigned long long blocks = device.size() / block;
+        if (blocks == 0 || block % device.logical_sector_size() != 0)
+            throw std::invalid_argument("Device too small or block size not a multiple of the sector size");
+        report.context("target", path);
+        report.context("block", std::to_string(block));
+        report.context("seconds", std::to_string(seconds));
+
+        for (unsigned int depth : {1u, 32u})
+        {
+            IoEngine engine(device, block, depth);
+            LatencyHistogram latency;
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+            uint64_t rng = 0x9E3779B97F4A7C15ULL;
+            unsigned int submitted = 0;
+            bool stop = false;
+            IoStats stats = engine.run(
+                [&](IoRequest &req)
+                {
+                    if (stop || ((submitted++ & 63) == 0 && std::chrono::steady_clock::now() >= deadline))
+                        return stop = true, false;
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+                    req.offset = (rng % blocks) * block;
+                    req.length = block;
+                    return true;
+                },
+                [&](const IoRequest &, std::chrono::nanoseconds ns)
+                { latency.record(static_cast<uint64_t>(ns.count())); });
+
+            const std::string qd = "QD" + std::to_string(depth);
+            report.add(qd + " random read", stats.iops(), "IOPS");
+            report.add(qd + " random read", stats.mb_per_sec(), "MB/s");
+            report.add(qd + " latency p50", latency.percentile(0.50) / 1000.0, "us");
+            report.add(qd + " latency p99", latency.percentile(0.99) / 1000.0, "us");
+        }
+        report.print();
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+        rc = 1;
+    }
+
+    if (target.empty())
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+    return rc;
+}
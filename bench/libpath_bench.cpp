@@ -0,0 +1,65 @@
+// Cost of libpath's destination naming with many files: indexing an existing destination, then
+// assigning names to distinct files and to files that all collide on a few stems.
+// Usage: libpath_bench [files] [--json]
+#define LIBPATH_NO_MAIN
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "../libpath.cpp"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("libpath", argc, argv);
+    const size_t files = report.number(0, 100000);
+    const size_t stems = std::max<size_t>(1, files / 1000);
+    report.context("files", std::to_string(files));
+    report.context("colliding stems", std::to_string(stems));
+
+    std::vector<fs::path> distinct, colliding;
+    distinct.reserve(files);
+    colliding.reserve(files);
+    for (size_t i = 0; i < files; ++i)
+    {
+        distinct.emplace_back("IMG_" + std::to_string(i) + ".jpg");
+        colliding.emplace_back("capture_" + std::to_string(i % stems) + ".bin");
+    }
+
+    auto per_name = [&](auto &&fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(files);
+    };
+
+    NameIndex existing;
+    double index_ns = per_name([&]
+                               {
+        for (const auto &p : distinct)
+            existing.add(p); });
+
+    // The same names again: every one is taken, so each gets the first free tag.
+    double retag_ns = per_name([&]
+                               {
+        for (const auto &p : distinct)
+            keep(existing.assign(path_stem_generic(p), path_ext_generic(p))); });
+
+    NameIndex fresh;
+    double distinct_ns = per_name([&]
+                                  {
+        for (const auto &p : distinct)
+            keep(fresh.assign(path_stem_generic(p), path_ext_generic(p))); });
+
+    NameIndex crowded;
+    double colliding_ns = per_name([&]
+                                   {
+        for (const auto &p : colliding)
+            keep(crowded.assign(path_stem_generic(p), path_ext_generic(p))); });
+
+    report.add("index existing names", index_ns, "ns/name");
+    report.add("assign, all names taken", retag_ns, "ns/name");
+    report.add("assign distinct names", distinct_ns, "ns/name");
+    report.add("assign colliding names", colliding_ns, "ns/name");
+    report.print();
+    return 0;
+}
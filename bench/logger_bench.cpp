@@ -0,0 +1,82 @@
+// Microbenchmark for Logger message formatting: ns/record for the {} and printf paths,
+// the binary sink and a disabled level, then the {}, printf and binary paths from several threads at once.
+// Records go to a discarding stream buffer so the numbers reflect formatting, not the terminal.
+// Usage: logger_bench [iterations] [threads] [--json]
+#include "../logger.hpp"
+#include "bench.hpp"
+#include <cstdio>
+#include <streambuf>
+#include <thread>
+
+class NullBuffer : public std::streambuf
+{
+protected:
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+// Records per second with every thread logging iterations records through fn.
+template <typename Fn>
+static double records_per_sec(size_t threads, size_t iterations, Fn &&fn)
+{
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&]
+                             {
+            for (size_t i = 0; i < iterations; ++i)
+                fn(i); });
+    for (auto &w : workers)
+        w.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(threads * iterations) / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("logger", argc, argv);
+    const size_t iterations = report.number(0, 1000000);
+    const size_t threads = report.number(1, 4);
+    const std::string path = "/mnt/data/some/long/path/file.bin";
+    report.context("iterations", std::to_string(iterations));
+    report.context("threads", std::to_string(threads));
+
+    NullBuffer null_buf;
+    std::streambuf *saved = std::cout.rdbuf(&null_buf);
+
+    auto fmt = [&](size_t i)
+    { LOG_INFO("offset {} lba {:#x} path {} ratio {:.3f}", i, i * 8, path, 0.5); };
+    auto printf_style = [&](size_t i)
+    { LOG_INFO("offset %zu lba %#zx path %s ratio %.3f", i, i * 8, path, 0.5); };
+
+    double fmt_ns = ns_per_call(iterations, fmt);
+    double printf_ns = ns_per_call(iterations, printf_style);
+    // STEP is below the INFO threshold but never compiled out, so this is the runtime check.
+    Logger::get().set_level(LogLevel::LOG_INFO);
+    double filtered_ns = ns_per_call(iterations, [&](size_t i)
+                                     { LOG_STEP("offset {} path {}", i, path); });
+
+    // Several threads share the sink, so this shows what the output lock costs.
+    double fmt_mt = records_per_sec(threads, iterations / threads, fmt);
+    double printf_mt = records_per_sec(threads, iterations / threads, printf_style);
+
+#ifndef _WIN32
+    Logger::get().set_binary_logfile("/dev/null");
+#else
+    Logger::get().set_binary_logfile("NUL");
+#endif
+    double binary_ns = ns_per_call(iterations, fmt);
+    double binary_mt = records_per_sec(threads, iterations / threads, fmt);
+    Logger::get().set_binary_logfile("");
+
+    std::cout.rdbuf(saved);
+    report.add("format {}", fmt_ns, "ns/record");
+    report.add("printf %", printf_ns, "ns/record");
+    report.add("binary sink", binary_ns, "ns/record");
+    report.add("disabled level", filtered_ns, "ns/record");
+    report.add("format {} threaded", fmt_mt / 1e6, "Mrecords/s");
+    report.add("printf % threaded", printf_mt / 1e6, "Mrecords/s");
+    report.add("binary sink threaded", binary_mt / 1e6, "Mrecords/s");
+    report.print();
+    return 0;
+}
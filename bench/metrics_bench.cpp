@@ -0,0 +1,51 @@
+// Cost of a metrics sample: ns per METRIC_INC, METRIC_RECORD and METRIC_TIMER on one thread, then
+// counter rate with several threads bumping the same name (each into its own slot).
+// Usage: metrics_bench [iterations] [threads] [--json]
+#include "../metrics.hpp"
+#include "bench.hpp"
+#include <thread>
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("metrics", argc, argv);
+    const size_t iterations = report.number(0, 10000000);
+    const size_t threads = report.number(1, 4);
+    report.context("iterations", std::to_string(iterations));
+    report.context("threads", std::to_string(threads));
+
+    double inc_ns = ns_per_call(iterations, [](size_t)
+                                { METRIC_INC("bench.counter"); });
+    double record_ns = ns_per_call(iterations, [](size_t i)
+                                   { METRIC_RECORD("bench.histogram", i); });
+    double timer_ns = ns_per_call(iterations / 10, [](size_t)
+                                  { METRIC_TIMER("bench.timer_ns"); });
+
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&]
+                             {
+            for (size_t i = 0; i < iterations / threads; ++i)
+                METRIC_INC("bench.shared_counter"); });
+    for (auto &w : workers)
+        w.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // The snapshot sums every slot, so it also checks that no increment was lost.
+    uint64_t total = 0;
+    for (const metrics::CounterValue &c : metrics::Registry::get().snapshot().counters)
+        if (c.name == "bench.shared_counter")
+            total = c.value;
+    if (total != iterations / threads * threads)
+    {
+        std::cerr << "bench.shared_counter is " << total << ", expected " << iterations / threads * threads << std::endl;
+        return 1;
+    }
+
+    report.add("METRIC_INC", inc_ns, "ns/sample");
+    report.add("METRIC_RECORD", record_ns, "ns/sample");
+    report.add("METRIC_TIMER", timer_ns, "ns/scope");
+    report.add("METRIC_INC threaded", static_cast<double>(total) / seconds / 1e6, "Msamples/s");
+    report.print();
+    return 0;
+}
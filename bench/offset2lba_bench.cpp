@@ -0,0 +1,69 @@
+// Cost of translating file offsets to LBAs: one get_lba_batch() call per offset (what a caller
+// looping over get_lba pays) against one call for all of them, plus a whole extent map.
+// The file is written and synced first so that the numbers leave out writeback.
+// Usage: offset2lba_bench [file] [MiB] [offsets] [--json]
+#include "../blockio.hpp"
+#include "bench.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    BenchReport report("offset2lba", argc, argv);
+    const fs::path file = path_from_utf8(report.arg(0, "offset2lba_bench.bin"));
+    const unsigned long long size = report.number(1, 256) << 20;
+    const size_t count = report.number(2, 10000);
+    report.context("file", path_to_utf8(file));
+    report.context("size", std::to_string(size >> 20) + " MiB");
+    report.context("offsets", std::to_string(count));
+
+    {
+        blockio::Handle out = blockio::open_file(file, blockio::create);
+        blockio::AlignedBuffer chunk(1 << 20);
+        for (size_t i = 0; i < chunk.size(); ++i)
+            chunk.data()[i] = static_cast<char>(i * 131 + 7);
+        for (unsigned long long at = 0; at < size; at += chunk.size())
+            blockio::write_full_at(out, chunk.data(), chunk.size(), at);
+    }
+    // Settle delayed allocation now, outside the timed part.
+    get_extent_map(file, true);
+
+    std::mt19937_64 rng(42);
+    std::vector<unsigned long long> offsets(count);
+    for (auto &o : offsets)
+        o = rng() % size;
+
+    unsigned long long mapped = 0;
+    auto sink = [&](const LbaResult &r)
+    { mapped += r.mapped; };
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long o : offsets)
+    {
+        std::vector<unsigned long long> one{o};
+        get_lba_batch(file, one, sink, false);
+    }
+    double single_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    std::vector<unsigned long long> all = offsets;
+    start = std::chrono::steady_clock::now();
+    get_lba_batch(file, all, sink, false);
+    double batch_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    size_t extents = 0;
+    double map_ns = ns_per_call(100, [&](size_t)
+                                { extents = get_extent_map(file, false).extents.size(); });
+    report.context("extents", std::to_string(extents));
+
+    std::error_code ec;
+    fs::remove(file, ec);
+
+    if (mapped != 2 * count)
+        fprintf(stderr, "warning: %llu of %zu lookups were not mapped\n", 2 * count - mapped, 2 * count);
+    report.add("single offset per call", single_ns / 1000, "us/offset");
+    report.add("batch of all offsets", batch_ns, "ns/offset");
+    report.add("get_extent_map", map_ns / 1000, "us/call");
+    report.print();
+    return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Builds the benches (Release unless PROFILE says otherwise) and runs them all, writing one JSON
+# document to the given file (default build/bench-<commit>.json) so results can be compared
+# between releases. Arguments after the file go to make.sh, e.g. --lto --march native.
+# DISKRW_TARGET picks the file or device for diskrw_bench (default: a scratch file here).
+cd "$(dirname "$0")/.." || exit 1
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+out=${1:-build/bench-$commit.json}
+[ $# -gt 0 ] && shift
+PROFILE=${PROFILE:-Release}
+
+bash make.sh -p "$PROFILE" "$@" bench >&2 || exit 1
+bindir="build/$PROFILE/bench"
+[ "$PROFILE" = "Debug" ] && bindir="build/bench"
+
+{
+    printf '{"commit":"%s","date":"%s","profile":"%s","flags":"%s","compiler":"%s","benchmarks":[\n' \
+        "$commit" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$PROFILE" "$*" "$(g++ -dumpfullversion)"
+    first=1
+    for bin in "$bindir"/*_bench; do
+        case "$(basename "$bin")" in
+        diskrw_bench) line=$("$bin" "${DISKRW_TARGET:-}" --json) ;;
+        *) line=$("$bin" --json) ;;
+        esac || {
+            echo "$(basename "$bin") failed" >&2
+            continue
+        }
+        [ $first -eq 1 ] || printf ',\n'
+        printf '%s' "$line"
+        first=0
+    done
+    printf '\n]}\n'
+} >"$out"
+echo "Wrote $out" >&2
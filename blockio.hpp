@@ -0,0 +1,582 @@
+#ifndef BLOCKIO_HPP
+#define BLOCKIO_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#endif
+
+// File offset -> LBA translation lives in offset2lba_{linux,windows}.cpp; tools that use it link
+// one of them.
+#include "offset2lba.hpp"
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+using native_handle_t = void *; // HANDLE
+using os_string_t = std::wstring;
+#else
+using native_handle_t = int;
+using os_string_t = std::string;
+#endif
+
+// Command line paths are UTF-8 on every platform (wmain converts them).
+inline fs::path path_from_utf8(const std::string &s)
+{
+    return fs::path(std::u8string(s.begin(), s.end()));
+}
+
+inline std::string path_to_utf8(const fs::path &p)
+{
+    auto u8 = p.u8string();
+    return std::string(u8.begin(), u8.end());
+}
+
+inline os_string_t from_utf8(const std::string &s)
+{
+#ifdef _WIN32
+    if (s.empty())
+        return {};
+    int size_needed = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0);
+    if (size_needed <= 0)
+        return {};
+    std::wstring wstr(size_needed, 0);
+    MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), &wstr[0], size_needed);
+    return wstr;
+#else
+    return s;
+#endif
+}
+
+// Block I/O shared by diskrw, offset2lba and test: handles, aligned buffers, sector geometry and
+// positional reads and writes. Everything throws std::system_error.
+namespace blockio
+{
+    inline native_handle_t invalid_handle()
+    {
+#ifdef _WIN32
+        return INVALID_HANDLE_VALUE;
+#else
+        return -1;
+#endif
+    }
+
+    // Owns a file descriptor / HANDLE. Converts to the native handle so it can be passed straight
+    // to the OS calls.
+    class Handle
+    {
+    public:
+        Handle() = default;
+        explicit Handle(native_handle_t h) : h_(h) {}
+        ~Handle() { reset(); }
+
+        Handle(Handle &&other) noexcept : h_(other.release()) {}
+        Handle &operator=(Handle &&other) noexcept
+        {
+            if (this != &other)
+                reset(other.release());
+            return *this;
+        }
+
+        Handle(const Handle &) = delete;
+        Handle &operator=(const Handle &) = delete;
+
+        native_handle_t get() const { return h_; }
+        operator native_handle_t() const { return h_; }
+
+        bool valid() const
+        {
+#ifdef _WIN32
+            return h_ != INVALID_HANDLE_VALUE && h_ != NULL;
+#else
+            return h_ >= 0;
+#endif
+        }
+
+        native_handle_t release() { return std::exchange(h_, invalid_handle()); }
+
+        void reset(native_handle_t h = invalid_handle())
+        {
+            if (valid())
+            {
+#ifdef _WIN32
+                CloseHandle(h_);
+#else
+                close(h_);
+#endif
+            }
+            h_ = h;
+        }
+
+    private:
+        native_handle_t h_ = invalid_handle();
+    };
+
+    enum OpenMode : unsigned
+    {
+        read_only = 0,
+        read_write = 1u << 0,
+        create = 1u << 1,     // create, or truncate an existing file (implies read_write)
+        direct = 1u << 2,     // bypass the cache: O_DIRECT / FILE_FLAG_NO_BUFFERING
+        overlapped = 1u << 3, // FILE_FLAG_OVERLAPPED; ignored on Linux
+    };
+
+    inline Handle open_file(const fs::path &path, unsigned mode)
+    {
+        const bool writable = mode & (read_write | create);
+#ifdef _WIN32
+        DWORD attributes = FILE_ATTRIBUTE_NORMAL;
+        if (mode & direct)
+            attributes |= FILE_FLAG_NO_BUFFERING;
+        if (mode & overlapped)
+            attributes |= FILE_FLAG_OVERLAPPED;
+        Handle h(CreateFileW(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             NULL, (mode & create) ? CREATE_ALWAYS : OPEN_EXISTING, attributes, NULL));
+        if (!h.valid())
+            throw std::system_error(GetLastError(), std::system_category(), "Failed to open " + path_to_utf8(path));
+#else
+        int flags = (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC;
+        if (mode & create)
+            flags |= O_CREAT | O_TRUNC;
+        if (mode & direct)
+            flags |= O_DIRECT;
+        Handle h(open(path.c_str(), flags, 0666));
+        if (!h.valid())
+            throw std::system_error(errno, std::generic_category(), "Failed to open " + path_to_utf8(path));
+#endif
+        return h;
+    }
+
+    // Page-aligned memory suitable for unbuffered (FILE_FLAG_NO_BUFFERING / O_DIRECT) transfers.
+    inline size_t page_size()
+    {
+#ifdef _WIN32
+        static const size_t size = []
+        {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return static_cast<size_t>(info.dwPageSize);
+        }();
+#else
+        static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return size;
+    }
+
+    inline void *alloc_aligned(size_t size, size_t alignment)
+    {
+#ifdef _WIN32
+        // VirtualAlloc always returns page (in fact 64 KiB) aligned memory.
+        if (alignment > page_size())
+            throw std::invalid_argument("Alignment larger than a page is not supported");
+        void *ptr = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!ptr)
+            throw std::system_error(GetLastError(), std::system_category(), "VirtualAlloc failed");
+        return ptr;
+#else
+        void *ptr = nullptr;
+        int err = posix_memalign(&ptr, alignment, size);
+        if (err != 0)
+            throw std::system_error(err, std::generic_category(), "posix_memalign failed");
+        return ptr;
+#endif
+    }
+
+    inline void free_aligned(void *ptr)
+    {
+#ifdef _WIN32
+        if (ptr)
+            VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+        std::free(ptr);
+#endif
+    }
+
+    // One aligned allocation, freed when the buffer goes away.
+    class AlignedBuffer
+    {
+    public:
+        AlignedBuffer() = default;
+        explicit AlignedBuffer(size_t size, size_t alignment = page_size())
+            : data_(size ? static_cast<char *>(alloc_aligned(size, alignment)) : nullptr), size_(size)
+        {
+        }
+        ~AlignedBuffer() { free_aligned(data_); }
+
+        AlignedBuffer(AlignedBuffer &&other) noexcept
+            : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+        {
+        }
+        AlignedBuffer &operator=(AlignedBuffer &&other) noexcept
+        {
+            if (this != &other)
+            {
+                free_aligned(data_);
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        AlignedBuffer(const AlignedBuffer &) = delete;
+        AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+        char *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        char *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Fixed-size aligned buffers that are handed out again and again. They are slices of a single
+    // allocation, so a pool costs one allocation however many buffers it has.
+    class BufferPool
+    {
+    public:
+        BufferPool(size_t buffer_size, size_t count, size_t alignment = page_size())
+            : buffer_size_(buffer_size), stride_((buffer_size + alignment - 1) / alignment * alignment), arena_(stride_ * count, alignment)
+        {
+            free_.reserve(count);
+            for (size_t i = count; i-- > 0;)
+                free_.push_back(arena_.data() + i * stride_);
+        }
+
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // Returns nullptr when every buffer is in use.
+        char *acquire()
+        {
+            if (free_.empty())
+                return nullptr;
+            char *buf = free_.back();
+            free_.pop_back();
+            return buf;
+        }
+
+        void release(char *buf) { free_.push_back(buf); }
+
+        size_t buffer_size() const { return buffer_size_; }
+
+    private:
+        size_t buffer_size_;
+        size_t stride_;
+        AlignedBuffer arena_;
+        std::vector<char *> free_;
+    };
+
+    // Transfer granularity and size of a disk or file.
+    struct Geometry
+    {
+        unsigned int logical_sector_size = 512;
+        unsigned int physical_sector_size = 512;
+        unsigned long long size = 0; // 0 if unknown
+    };
+
+    // name only goes into error messages.
+    inline Geometry query_geometry(native_handle_t h, const std::string &name = {})
+    {
+        Geometry g;
+#ifdef _WIN32
+        (void)name;
+        DWORD bytesReturned;
+        STORAGE_PROPERTY_QUERY query = {};
+        query.PropertyId = StorageAccessAlignmentProperty;
+        query.QueryType = PropertyStandardQuery;
+        STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment = {};
+        if (DeviceIoControl(h, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &alignment, sizeof(alignment), &bytesReturned, NULL) &&
+            alignment.BytesPerLogicalSector)
+        {
+            g.logical_sector_size = alignment.BytesPerLogicalSector;
+            g.physical_sector_size = std::max(alignment.BytesPerPhysicalSector, alignment.BytesPerLogicalSector);
+        }
+        else
+        {
+            DISK_GEOMETRY_EX geometry = {};
+            if (DeviceIoControl(h, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &geometry, sizeof(geometry), &bytesReturned, NULL))
+                g.logical_sector_size = g.physical_sector_size = geometry.Geometry.BytesPerSector;
+        }
+
+        GET_LENGTH_INFORMATION length = {};
+        if (DeviceIoControl(h, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length), &bytesReturned, NULL))
+        {
+            g.size = static_cast<unsigned long long>(length.Length.QuadPart);
+        }
+        else
+        {
+            LARGE_INTEGER fileSize;
+            if (GetFileSizeEx(h, &fileSize))
+                g.size = static_cast<unsigned long long>(fileSize.QuadPart);
+        }
+#else
+        struct stat st;
+        if (fstat(h, &st) != 0)
+            throw std::system_error(errno, std::generic_category(), name.empty() ? "fstat failed" : "fstat failed on " + name);
+
+        if (S_ISBLK(st.st_mode))
+        {
+            int logical = 0;
+            unsigned int physical = 0;
+            uint64_t bytes = 0;
+            if (ioctl(h, BLKSSZGET, &logical) == 0 && logical > 0)
+                g.logical_sector_size = static_cast<unsigned int>(logical);
+            if (ioctl(h, BLKPBSZGET, &physical) == 0 && physical > 0)
+                g.physical_sector_size = physical;
+            else
+                g.physical_sector_size = g.logical_sector_size;
+            if (ioctl(h, BLKGETSIZE64, &bytes) == 0)
+                g.size = bytes;
+        }
+        else
+        {
+            // A regular file: O_DIRECT alignment is that of the file system block, which st_blksize
+            // reports conservatively.
+            g.logical_sector_size = g.physical_sector_size = static_cast<unsigned int>(st.st_blksize);
+            g.size = static_cast<unsigned long long>(st.st_size);
+        }
+#endif
+        return g;
+    }
+
+    // One buffer of a vectored transfer. Laid out like struct iovec so that preadv can take an
+    // array of them as is.
+    struct Segment
+    {
+        void *data;
+        size_t size;
+    };
+
+#ifndef _WIN32
+    static_assert(sizeof(Segment) == sizeof(struct iovec) && offsetof(Segment, data) == offsetof(struct iovec, iov_base) &&
+                  offsetof(Segment, size) == offsetof(struct iovec, iov_len));
+#endif
+
+    namespace detail
+    {
+#ifdef _WIN32
+        // Reads or writes at offset whether or not the handle was opened for overlapped I/O. Must not
+        // be used on a handle bound to a completion port.
+        inline size_t transfer_at(HANDLE h, void *buf, size_t len, unsigned long long offset, bool write)
+        {
+            OVERLAPPED ov = {};
+            ov.Offset = static_cast<DWORD>(offset);
+            ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            const DWORD want = static_cast<DWORD>(std::min<size_t>(len, 1u << 30));
+            DWORD done = 0;
+            BOOL ok = write ? WriteFile(h, buf, want, &done, &ov) : ReadFile(h, buf, want, &done, &ov);
+            if (!ok && GetLastError() == ERROR_IO_PENDING)
+                ok = GetOverlappedResult(h, &ov, &done, TRUE);
+            if (!ok)
+            {
+                if (!write && GetLastError() == ERROR_HANDLE_EOF)
+                    return 0;
+                throw std::system_error(GetLastError(), std::system_category(), write ? "WriteFile failed" : "ReadFile failed");
+            }
+            return done;
+        }
+#endif
+    } // namespace detail
+
+    // One positional read: returns the bytes read, which is less than len only at the end of the
+    // file (or for a large len on Windows, where a call moves at most 1 GiB).
+    inline size_t read_at(native_handle_t h, void *buf, size_t len, unsigned long long offset)
+    {
+#ifdef _WIN32
+        return detail::transfer_at(h, buf, len, offset, false);
+#else
+        while (true)
+        {
+            ssize_t n = pread(h, buf, len, static_cast<off_t>(offset));
+            if (n >= 0)
+                return static_cast<size_t>(n);
+            if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "pread failed");
+        }
+#endif
+    }
+
+    inline size_t write_at(native_handle_t h, const void *buf, size_t len, unsigned long long offset)
+    {
+#ifdef _WIN32
+        return detail::transfer_at(h, const_cast<void *>(buf), len, offset, true);
+#else
+        while (true)
+        {
+            ssize_t n = pwrite(h, buf, len, static_cast<off_t>(offset));
+            if (n >= 0)
+                return static_cast<size_t>(n);
+            if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "pwrite failed");
+        }
+#endif
+    }
+
+    // Reads until len bytes are in or the file ends; returns the bytes read.
+    inline size_t read_full_at(native_handle_t h, void *buf, size_t len, unsigned long long offset)
+    {
+        size_t done = 0;
+        while (done < len)
+        {
+            size_t n = read_at(h, static_cast<char *>(buf) + done, len - done, offset + done);
+            if (n == 0)
+                break;
+            done += n;
+        }
+        return done;
+    }
+
+    inline void write_full_at(native_handle_t h, const void *buf, size_t len, unsigned long long offset)
+    {
+        size_t done = 0;
+        while (done < len)
+        {
+            size_t n = write_at(h, static_cast<const char *>(buf) + done, len - done, offset + done);
+            if (n == 0)
+                throw std::system_error(std::make_error_code(std::errc::io_error), "Short write");
+            done += n;
+        }
+    }
+
+    // Writes the file's cached data out to the device.
+    inline void flush(native_handle_t h)
+    {
+#ifdef _WIN32
+        if (!FlushFileBuffers(h))
+            throw std::system_error(GetLastError(), std::system_category(), "FlushFileBuffers failed");
+#else
+        if (fsync(h) != 0)
+            throw std::system_error(errno, std::generic_category(), "fsync failed");
+#endif
+    }
+
+    // Asks the system to forget the file's clean cached pages, so that later reads go to the
+    // device. Returns false where that cannot be requested (Windows has no such call).
+    inline bool drop_cache(native_handle_t h)
+    {
+#ifdef _WIN32
+        (void)h;
+        return false;
+#else
+        return posix_fadvise(h, 0, 0, POSIX_FADV_DONTNEED) == 0;
+#endif
+    }
+
+    // Reads consecutive bytes starting at offset into the segments in order, with one preadv per
+    // IOV_MAX segments on Linux and one read per segment on Windows (ReadFileScatter only takes
+    // whole pages on unbuffered handles). Stops early at the end of the file.
+    inline size_t readv_at(native_handle_t h, std::span<const Segment> segments, unsigned long long offset)
+    {
+        size_t total = 0;
+#ifdef _WIN32
+        for (const Segment &s : segments)
+        {
+            size_t n = read_full_at(h, s.data, s.size, offset + total);
+            total += n;
+            if (n < s.size)
+                break;
+        }
+#else
+        while (!segments.empty())
+        {
+            const size_t count = std::min<size_t>(segments.size(), IOV_MAX);
+            size_t want = 0;
+            for (size_t i = 0; i < count; ++i)
+                want += segments[i].size;
+            ssize_t n = preadv(h, reinterpret_cast<const struct iovec *>(segments.data()), static_cast<int>(count), static_cast<off_t>(offset + total));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "preadv failed");
+            }
+            total += static_cast<size_t>(n);
+            if (static_cast<size_t>(n) < want)
+            {
+                // Short: finish the partly filled segment, then the rest, one read at a time.
+                size_t in = static_cast<size_t>(n);
+                size_t i = 0;
+                while (in >= segments[i].size)
+                    in -= segments[i++].size;
+                for (; i < count; ++i, in = 0)
+                {
+                    size_t got = read_full_at(h, static_cast<char *>(segments[i].data) + in, segments[i].size - in, offset + total);
+                    total += got;
+                    if (got < segments[i].size - in)
+                        return total;
+                }
+            }
+            segments = segments.subspan(count);
+        }
+#endif
+        return total;
+    }
+
+    // Writes the segments back to back starting at offset.
+    inline void writev_at(native_handle_t h, std::span<const Segment> segments, unsigned long long offset)
+    {
+#ifdef _WIN32
+        for (const Segment &s : segments)
+        {
+            write_full_at(h, s.data, s.size, offset);
+            offset += s.size;
+        }
+#else
+        while (!segments.empty())
+        {
+            const size_t count = std::min<size_t>(segments.size(), IOV_MAX);
+            size_t want = 0;
+            for (size_t i = 0; i < count; ++i)
+                want += segments[i].size;
+            ssize_t n = pwritev(h, reinterpret_cast<const struct iovec *>(segments.data()), static_cast<int>(count), static_cast<off_t>(offset));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "pwritev failed");
+            }
+            size_t in = static_cast<size_t>(n);
+            offset += in;
+            for (size_t i = 0; i < count; ++i)
+            {
+                // Short: finish the partly written segments one write at a time.
+                if (in >= segments[i].size)
+                {
+                    in -= segments[i].size;
+                    continue;
+                }
+                write_full_at(h, static_cast<const char *>(segments[i].data) + in, segments[i].size - in, offset);
+                offset += segments[i].size - in;
+                in = 0;
+            }
+            segments = segments.subspan(count);
+        }
+#endif
+    }
+} // namespace blockio
+
+#endif // BLOCKIO_HPP
@@ -0,0 +1,161 @@
+#ifndef COMPARE_HPP
+#define COMPARE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define COMPARE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define COMPARE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Buffer comparison that, unlike memcmp, tells where two buffers first differ. Kernels compare
+// 64 bytes per step and only look for the exact byte once a step differs.
+namespace compare_detail
+{
+    inline size_t scalar(const unsigned char *a, const unsigned char *b, size_t begin, size_t n)
+    {
+        size_t i = begin;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t x, y;
+            std::memcpy(&x, a + i, 8);
+            std::memcpy(&y, b + i, 8);
+            if (x != y)
+                break;
+        }
+        for (; i < n; ++i)
+            if (a[i] != b[i])
+                return i;
+        return n;
+    }
+
+#if defined(COMPARE_X86)
+    // SSE2 is part of x86-64, so this kernel needs no dispatch.
+    inline size_t sse2(const unsigned char *a, const unsigned char *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+            __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+            __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 32)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 32)));
+            __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 48)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 48)));
+            __m128i all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+            if (_mm_movemask_epi8(all) != 0xFFFF)
+                break;
+        }
+        return scalar(a, b, i, n);
+    }
+
+#if defined(__GNUC__)
+    __attribute__((target("avx2")))
+#endif
+    inline size_t
+    avx2(const unsigned char *a, const unsigned char *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+            __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 32)));
+            if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(e0, e1))) != 0xFFFFFFFFu)
+                break;
+        }
+        _mm256_zeroupper();
+        return scalar(a, b, i, n);
+    }
+
+    inline bool has_avx2()
+    {
+#if defined(_MSC_VER)
+        static const bool avx2 = []
+        {
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+        }();
+#else
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        return avx2;
+    }
+#elif defined(COMPARE_NEON)
+    inline size_t neon(const unsigned char *a, const unsigned char *b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            uint8x16_t e0 = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            uint8x16_t e1 = vceqq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16));
+            uint8x16_t e2 = vceqq_u8(vld1q_u8(a + i + 32), vld1q_u8(b + i + 32));
+            uint8x16_t e3 = vceqq_u8(vld1q_u8(a + i + 48), vld1q_u8(b + i + 48));
+            if (vminvq_u8(vandq_u8(vandq_u8(e0, e1), vandq_u8(e2, e3))) != 0xFF)
+                break;
+        }
+        return scalar(a, b, i, n);
+    }
+#endif
+} // namespace compare_detail
+
+// Name of the kernel first_mismatch() uses on this CPU.
+inline const char *compare_kernel()
+{
+#if defined(COMPARE_X86)
+    return compare_detail::has_avx2() ? "avx2" : "sse2";
+#elif defined(COMPARE_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+// Offset of the first byte where a and b differ, or n if the buffers are equal.
+inline size_t first_mismatch(const void *a, const void *b, size_t n)
+{
+    const unsigned char *pa = static_cast<const unsigned char *>(a);
+    const unsigned char *pb = static_cast<const unsigned char *>(b);
+#if defined(COMPARE_X86)
+    return compare_detail::has_avx2() ? compare_detail::avx2(pa, pb, n) : compare_detail::sse2(pa, pb, n);
+#elif defined(COMPARE_NEON)
+    return compare_detail::neon(pa, pb, n);
+#else
+    return compare_detail::scalar(pa, pb, 0, n);
+#endif
+}
+
+// Calls on_sector(index) for every sector_size block of the buffers that differs and returns
+// how many did. Equal stretches are skipped at kernel speed.
+inline size_t mismatching_sectors(const void *a, const void *b, size_t n, size_t sector_size,
+                                  const std::function<void(size_t sector)> &on_sector)
+{
+    const unsigned char *pa = static_cast<const unsigned char *>(a);
+    const unsigned char *pb = static_cast<const unsigned char *>(b);
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < n)
+    {
+        pos += first_mismatch(pa + pos, pb + pos, n - pos);
+        if (pos >= n)
+            break;
+        const size_t sector = pos / sector_size;
+        on_sector(sector);
+        ++count;
+        pos = std::min(n, (sector + 1) * sector_size);
+    }
+    return count;
+}
+
+#endif // COMPARE_HPP
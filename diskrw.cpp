@@ -1,99 +1,568 @@
+#include "diskrw.hpp"
+#include "pattern.hpp"
+#include "offset2lba.hpp"
+#include "argparser.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include <atomic>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <iomanip>
-#include <windows.h>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <system_error>
 
-int main(int argc, char *argv[])
+using namespace argparse;
+
+// "xx " for every byte value and the printable-or-dot column, built once.
+struct HexTables
 {
-    if (argc != 5)
+    char hex[256][3];
+    char ascii[256];
+
+    HexTables()
     {
-        std::cerr << "Usage: " << argv[0] << " [r/w] [disk_number] [lba] [size]" << std::endl;
-        return 1;
+        const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; ++i)
+        {
+            hex[i][0] = digits[i >> 4];
+            hex[i][1] = digits[i & 15];
+            hex[i][2] = ' ';
+            ascii[i] = std::isprint(i) ? static_cast<char>(i) : '.';
+        }
     }
+};
+
+// Formats lines as "offset  16 x 'xx '  ascii" into a large buffer that is written out in one
+// go per megabyte, instead of one iostream insertion per byte. Runs of identical lines collapse
+// into a single '*' like hexdump -C, unless all is set.
+static void hexdump(const char *data, size_t size, std::FILE *out, bool all = false)
+{
+    static const HexTables tables;
+    constexpr size_t lineBytes = 8 + 2 + 16 * 3 + 2 + 16 + 1;
+    constexpr size_t flushAt = 1 << 20;
 
-    std::string mode = argv[1];
-    int diskNumber = std::stoi(argv[2]);
-    long size = std::stol(argv[4]);
-    long long lba = std::stoll(argv[3]);
+    std::string buf;
+    buf.reserve(flushAt + 2 * lineBytes);
+    bool squeezing = false;
+    for (size_t i = 0; i < size; i += 16)
+    {
+        const size_t n = std::min<size_t>(16, size - i);
+        if (!all && i >= 16 && n == 16 && std::memcmp(data + i, data + i - 16, 16) == 0)
+        {
+            if (!squeezing)
+                buf += "*\n";
+            squeezing = true;
+            continue;
+        }
+        squeezing = false;
 
-    std::string diskPath = "\\\\.\\PhysicalDrive" + std::to_string(diskNumber);
+        const size_t pos = buf.size();
+        buf.resize(pos + lineBytes);
+        char *p = buf.data() + pos;
+        for (int shift = 28; shift >= 0; shift -= 4)
+            *p++ = "0123456789abcdef"[(i >> shift) & 15];
+        *p++ = ' ';
+        *p++ = ' ';
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data + i);
+        for (size_t j = 0; j < n; ++j, p += 3)
+            std::memcpy(p, tables.hex[bytes[j]], 3);
+        *p++ = ' ';
+        *p++ = ' ';
+        for (size_t j = 0; j < n; ++j)
+            *p++ = tables.ascii[bytes[j]];
+        *p++ = '\n';
+        buf.resize(static_cast<size_t>(p - buf.data()));
 
-    HANDLE hDevice = CreateFileA(diskPath.c_str(), mode == "r" ? GENERIC_READ : GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
-    if (hDevice == INVALID_HANDLE_VALUE)
+        if (buf.size() >= flushAt)
+        {
+            std::fwrite(buf.data(), 1, buf.size(), out);
+            buf.clear();
+        }
+    }
+    // Like hexdump -C, a dump that ends in a collapsed run closes with the total length.
+    if (squeezing)
     {
-        std::cerr << "Failed to open disk: " << diskPath << std::endl;
-        return 1;
+        char end[24];
+        std::snprintf(end, sizeof(end), "%08zx\n", size);
+        buf += end;
+    }
+    std::fwrite(buf.data(), 1, buf.size(), out);
+    std::fflush(out);
+}
+
+// A byte range of the device that the benchmark may touch.
+struct TargetRange
+{
+    unsigned long long start = 0;
+    unsigned long long length = 0;
+};
+
+// Maps block indices onto a list of ranges, so a file's extents can be benchmarked as if they
+// were one contiguous region.
+class BlockSpace
+{
+public:
+    BlockSpace(const std::vector<TargetRange> &ranges, size_t block_size) : block_size_(block_size)
+    {
+        for (const TargetRange &r : ranges)
+        {
+            unsigned long long blocks = r.length / block_size;
+            if (blocks == 0)
+                continue;
+            starts_.push_back(r.start);
+            first_block_.push_back(total_);
+            total_ += blocks;
+        }
+    }
+
+    unsigned long long blocks() const { return total_; }
+
+    unsigned long long offset_of(unsigned long long block) const
+    {
+        size_t i = static_cast<size_t>(std::upper_bound(first_block_.begin(), first_block_.end(), block) - first_block_.begin() - 1);
+        return starts_[i] + (block - first_block_[i]) * block_size_;
     }
 
-    const long long sectorSize = 512;
-    long long offset = lba * sectorSize;
+private:
+    size_t block_size_;
+    unsigned long long total_ = 0;
+    std::vector<unsigned long long> starts_;
+    std::vector<unsigned long long> first_block_;
+};
 
-    DWORD bytesRead, bytesWritten;
-    std::vector<char> buffer(size, 'A'); // Write arbitrary data (all 'A's in this example)
+struct BenchResult
+{
+    IoStats stats;
+    LatencyHistogram latency; // ns
+};
 
-    LARGE_INTEGER liOffset;
-    liOffset.QuadPart = offset;
+static void print_bench_line(const char *label, const IoStats &stats, const LatencyHistogram &h)
+{
+    std::printf("%-8s %10.0f IOPS %10.2f MB/s  lat(us) p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f\n", label, stats.iops(),
+                stats.mb_per_sec(), h.percentile(0.50) / 1e3, h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3, h.max() / 1e3);
+}
 
-    if (mode == "r")
+// "bench" command: fio-like sequential/random load with per-request latency percentiles.
+static int run_bench(int argc, char *argv[])
+{
+    ArgParser parser("Measure raw disk throughput and latency.");
+    parser.add_positional("disk", "Disk number (PhysicalDriveN), device name (nvme0n1) or path.", true);
+    parser.add_option("--rw", "-r", "read or write", false, "read");
+    parser.add_option("--pattern", "-p", "seq or rand", false, "rand");
+    parser.add_option("--block-size", "-b", "bytes per request (K/M suffix, s for sectors)", false, "4K");
+    parser.add_option("--queue-depth", "-q", "requests kept in flight per thread", false, "32");
+    parser.add_option("--threads", "-t", "worker threads", false, "1");
+    parser.add_option("--lba", "", "first LBA of the tested range", false, "0");
+    parser.add_option("--range", "", "bytes of the tested range (K/M/G/T suffix, s for sectors) [default: to the end of the disk]");
+    parser.add_option("--file", "", "test only the physical blocks of this file (reads only)");
+    parser.add_option("--time", "", "seconds to run", false, "10");
+    parser.add_option("--bytes", "", "stop after this many bytes instead (K/M/G/T suffix, s for sectors)");
+    parser.add_option("--log", "-L", "log level", false, "INFO");
+    parser.add_option("--metrics", "", "log I/O counters and latencies at exit: step or json");
+    parser.add_option("--metrics-interval", "", "seconds between metric dumps (0: only at exit)", false, "0");
+    if (!parser.parse(argc, argv))
     {
-        if (!SetFilePointerEx(hDevice, liOffset, NULL, FILE_BEGIN))
+        return 1;
+    }
+    Logger::get().set_level(parser.get("log").value());
+    std::optional<metrics::Reporter> reporter;
+    if (auto name = parser.get("metrics"))
+    {
+        auto format = metrics::parse_format(*name);
+        auto interval = parser.get<unsigned int>("metrics-interval");
+        if (!format || !interval)
         {
-            std::cerr << "Failed to set file pointer for reading." << std::endl;
-            CloseHandle(hDevice);
+            LOG_FATAL("--metrics takes step or json, --metrics-interval a number of seconds.");
             return 1;
         }
+        reporter.emplace(*format, std::chrono::seconds(*interval));
+    }
+
+    const std::string rw = parser.get("rw").value();
+    const std::string pattern = parser.get("pattern").value();
+    if ((rw != "read" && rw != "write") || (pattern != "seq" && pattern != "rand"))
+    {
+        LOG_FATAL("--rw must be read or write, --pattern seq or rand.");
+        return 1;
+    }
+    const bool write = rw == "write";
+    const bool random = pattern == "rand";
+    auto queueDepth = parser.get<unsigned int>("queue-depth");
+    auto threads = parser.get<unsigned int>("threads");
+    auto seconds = parser.get<double>("time");
+    auto firstLba = parser.get_size("lba");
+    if (!queueDepth || !*queueDepth || !threads || !*threads || !seconds || !firstLba)
+    {
+        LOG_FATAL("Invalid queue depth, thread count, time or LBA.");
+        return 1;
+    }
+    if (write && parser.is_set("file"))
+    {
+        LOG_FATAL("--file only supports reads; writing would overwrite the file's data.");
+        return 1;
+    }
 
-        if (!ReadFile(hDevice, buffer.data(), static_cast<DWORD>(size), &bytesRead, NULL))
+    try
+    {
+        const std::string path = disk_path(parser.get_positional("disk").value());
+        // One handle per worker, each with its own completion port.
+        std::vector<std::unique_ptr<Device>> devices;
+        for (unsigned int i = 0; i < *threads; ++i)
+            devices.push_back(std::make_unique<Device>(path, write));
+        const unsigned int sectorSize = devices[0]->logical_sector_size();
+        // Sizes may be given in sectors, so they are read once the sector size is known.
+        auto blockSize = parser.get_size("block-size", sectorSize);
+        if (!blockSize || !*blockSize)
         {
-            std::cerr << "Failed to read from disk: " << diskPath << std::endl;
-            CloseHandle(hDevice);
+            LOG_FATAL("Invalid block size: {}", *parser.get_view("block-size"));
+            return 1;
+        }
+        std::optional<unsigned long long> byteLimit;
+        if (auto bytes = parser.get_view("bytes"))
+        {
+            byteLimit = parse_size(*bytes, sectorSize);
+            if (!byteLimit)
+            {
+                LOG_FATAL("Invalid byte count: {}", *bytes);
+                return 1;
+            }
+        }
+        if (*blockSize % sectorSize)
+        {
+            LOG_FATAL("Block size must be a multiple of the {}-byte sector size.", sectorSize);
             return 1;
         }
 
-        std::cout << "Read " << static_cast<DWORD>(size) << " bytes from LBA " << static_cast<DWORD>(lba) << std::endl;
-        // Print 16 bytes of data by hexdump
-        for (size_t i = 0; i < size; i += 16)
+        std::vector<TargetRange> ranges;
+        if (auto file = parser.get("file"))
+        {
+            ExtentMap map = get_extent_map(path_from_utf8(*file));
+            if (map.sector_size != sectorSize)
+                LOG_WARNING("File system reports {}-byte sectors, the disk {}.", map.sector_size, sectorSize);
+            if (map.disks.size() > 1)
+            {
+                LOG_FATAL("{} spans {} disks; test each disk separately.", *file, map.disks.size());
+                return 1;
+            }
+            for (const FileExtent &e : merge_extents(map.extents))
+                ranges.push_back({e.disk_offset, e.length});
+            LOG_INFO("Testing {} extents of {} on {}", ranges.size(), *file, map.disks.empty() ? std::string() : map.disks[0]);
+        }
+        else
         {
-            std::cout << std::hex << std::setw(8) << std::setfill('0') << i << "  ";
-            for (size_t j = 0; j < 16 && i + j < buffer.size(); ++j)
+            const unsigned long long start = *firstLba * sectorSize;
+            unsigned long long length = 0;
+            if (auto range = parser.get_view("range"))
             {
-                std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(static_cast<unsigned char>(buffer[i + j])) << " ";
+                auto value = parse_size(*range, sectorSize);
+                if (!value)
+                {
+                    LOG_FATAL("Invalid range: {}", *range);
+                    return 1;
+                }
+                length = *value;
             }
-            std::cout << "  ";
-            for (size_t j = 0; j < 16 && i + j < buffer.size(); ++j)
+            else if (devices[0]->size() > start)
             {
-                char c = buffer[i + j];
-                std::cout << (std::isprint(c) ? c : '.');
+                length = devices[0]->size() - start;
             }
-            std::cout << std::endl;
+            ranges.push_back({start, length});
+        }
+
+        const size_t block = static_cast<size_t>(*blockSize);
+        BlockSpace space(ranges, block);
+        if (space.blocks() < *threads)
+        {
+            LOG_FATAL("The tested range holds fewer blocks than there are threads.");
+            return 1;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                                     std::chrono::duration<double>(*seconds));
+        // Byte limit: every request takes its share from here before it is submitted.
+        std::atomic<long long> budget(byteLimit ? static_cast<long long>(*byteLimit) : 0);
+        std::vector<BenchResult> results(*threads);
+        std::vector<std::string> errors(*threads);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < *threads; ++t)
+        {
+            workers.emplace_back([&, t]
+                                 {
+                try
+                {
+                    IoEngine engine(*devices[t], block, *queueDepth);
+                    // Sequential workers stream through their own slice; random ones roam the whole range.
+                    const unsigned long long sliceBlocks = space.blocks() / *threads;
+                    const unsigned long long sliceStart = random ? 0 : t * sliceBlocks;
+                    const unsigned long long sliceLen = random ? space.blocks() : sliceBlocks;
+                    unsigned long long cursor = 0;
+                    uint64_t rng = 0x9E3779B97F4A7C15ULL * (t + 1);
+                    unsigned int submitted = 0;
+                    bool stop = false;
+                    results[t].stats = engine.run(
+                        [&](IoRequest &req)
+                        {
+                            // Reading the clock every 64 requests keeps it off the hot path.
+                            if (stop || (!byteLimit && (submitted++ & 63) == 0 && std::chrono::steady_clock::now() >= deadline))
+                                return stop = true, false;
+                            if (byteLimit && budget.fetch_sub(static_cast<long long>(block), std::memory_order_relaxed) < static_cast<long long>(block))
+                                return stop = true, false;
+                            unsigned long long index;
+                            if (random)
+                            {
+                                rng ^= rng << 13;
+                                rng ^= rng >> 7;
+                                rng ^= rng << 17;
+                                index = rng % sliceLen;
+                            }
+                            else
+                            {
+                                index = cursor++ % sliceLen;
+                            }
+                            req.offset = space.offset_of(sliceStart + index);
+                            req.length = block;
+                            req.write = write;
+                            return true;
+                        },
+                        [&](const IoRequest &, std::chrono::nanoseconds latency)
+                        { results[t].latency.record(static_cast<uint64_t>(latency.count())); });
+                }
+                catch (const std::exception &e)
+                {
+                    errors[t] = e.what();
+                } });
         }
+        for (auto &w : workers)
+            w.join();
+        for (unsigned int t = 0; t < *threads; ++t)
+        {
+            if (!errors[t].empty())
+            {
+                LOG_FATAL("Worker {} failed: {}", t, errors[t]);
+                return 1;
+            }
+        }
+
+        std::printf("%s %s, %zu-byte blocks, queue depth %u, %u thread(s), %s\n", pattern.c_str(), rw.c_str(), block, *queueDepth,
+                    *threads, path.c_str());
+        IoStats total;
+        LatencyHistogram latency;
+        for (unsigned int t = 0; t < *threads; ++t)
+        {
+            if (*threads > 1)
+                print_bench_line(("thread" + std::to_string(t)).c_str(), results[t].stats, results[t].latency);
+            total.bytes += results[t].stats.bytes;
+            total.ios += results[t].stats.ios;
+            total.seconds = std::max(total.seconds, results[t].stats.seconds);
+            latency.merge(results[t].latency);
+        }
+        print_bench_line("total", total, latency);
+    }
+    catch (const std::system_error &e)
+    {
+        LOG_FATAL("Error: {} (code: {})", e.what(), e.code().value());
+        return 1;
     }
-    else if (mode == "w")
+    catch (const std::exception &e)
     {
-        if (!SetFilePointerEx(hDevice, liOffset, NULL, FILE_BEGIN))
+        LOG_FATAL("Error: {}", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string_view(argv[1]) == "bench")
+    {
+        return run_bench(argc - 1, argv + 1);
+    }
+
+    ArgParser parser("Read or write raw disk sectors. ver. 0.3.0\n"
+                     "Use '" + std::string(argv[0]) + " bench <disk>' to measure throughput and latency.");
+    parser.add_positional("mode", "'r' to read, 'w' to write.", true);
+    parser.add_positional("disk", "Disk number (PhysicalDriveN), device name (nvme0n1) or path.", true);
+    parser.add_positional("lba", "First logical block, in units of the disk's logical sector size.", true);
+    parser.add_positional("size", "Bytes to transfer (K/M/G suffix, s for sectors), a multiple of the sector size.", true);
+    parser.add_option("--block-size", "-b", "bytes per request (K/M suffix, s for sectors)", false, "1M");
+    parser.add_option("--queue-depth", "-q", "requests kept in flight", false, "4");
+    parser.add_flag("--no-dump", "", "do not hexdump data that was read");
+    parser.add_flag("--all", "-a", "hexdump repeated lines instead of collapsing them into '*'");
+    parser.add_option("--output", "-o", "write the data that was read to this file as raw binary instead of a hexdump");
+    parser.add_option("--pattern", "-p", "data to write: fixed, lba (stamped sectors) or random (stamped, seeded)", false, "fixed");
+    parser.add_option("--seed", "-s", "seed of the random pattern, also recorded in every stamp", false, "0");
+    parser.add_option("--fill", "", "byte written by the fixed pattern", false, "0x41");
+    parser.add_flag("--verify", "-V", "check the data that was read against --pattern and report bad LBAs");
+    parser.add_option("--log", "-L", "log level", false, "INFO");
+    parser.add_option("--metrics", "", "log I/O counters and latencies at exit: step or json");
+    parser.add_option("--metrics-interval", "", "seconds between metric dumps (0: only at exit)", false, "0");
+    if (!parser.parse(argc, argv))
+    {
+        return 1;
+    }
+    Logger::get().set_level(parser.get("log").value());
+    std::optional<metrics::Reporter> reporter;
+    if (auto name = parser.get("metrics"))
+    {
+        auto format = metrics::parse_format(*name);
+        auto interval = parser.get<unsigned int>("metrics-interval");
+        if (!format || !interval)
         {
-            std::cerr << "Failed to set file pointer for writing." << std::endl;
-            CloseHandle(hDevice);
+            LOG_FATAL("--metrics takes step or json, --metrics-interval a number of seconds.");
             return 1;
         }
+        reporter.emplace(*format, std::chrono::seconds(*interval));
+    }
+
+    const std::string mode = parser.get_positional("mode").value();
+    if (mode != "r" && mode != "w")
+    {
+        LOG_FATAL("Invalid mode: {}. Use 'r' for read or 'w' for write.", mode);
+        return 1;
+    }
+    const bool write = mode == "w";
+
+    auto firstLba = parse_size(parser.get_positional_view("lba").value());
+    auto queueDepth = parser.get<unsigned int>("queue-depth");
+    if (!firstLba || !queueDepth || !*queueDepth)
+    {
+        LOG_FATAL("Invalid lba or queue depth.");
+        return 1;
+    }
+    const unsigned long long lba = *firstLba;
+    auto patternKind = DataPattern::parse(parser.get("pattern").value());
+    auto seed = parser.get<unsigned long long>("seed");
+    auto fill = parser.get<unsigned int>("fill");
+    if (!patternKind || !seed || !fill || *fill > 0xFF)
+    {
+        LOG_FATAL("Invalid pattern, seed or fill byte.");
+        return 1;
+    }
+    const bool verify = !write && parser.is_set("verify");
 
-        if (!WriteFile(hDevice, buffer.data(), static_cast<DWORD>(size), &bytesWritten, NULL))
+    try
+    {
+        Device device(disk_path(parser.get_positional("disk").value()), write);
+        const unsigned int sectorSize = device.logical_sector_size();
+        auto size = parse_size(parser.get_positional_view("size").value(), sectorSize);
+        auto blockSize = parser.get_size("block-size", sectorSize);
+        if (!size || !*size || !blockSize || !*blockSize)
+        {
+            LOG_FATAL("Invalid size or block size.");
+            return 1;
+        }
+        if (*size % sectorSize || *blockSize % sectorSize)
         {
-            std::cerr << "Failed to write to disk: " << diskPath << std::endl;
-            CloseHandle(hDevice);
+            LOG_FATAL("Size and block size must be multiples of the {}-byte sector size.", sectorSize);
             return 1;
         }
+        if (*patternKind != PatternKind::Fixed && sectorSize < 2 * sizeof(SectorStamp))
+        {
+            LOG_FATAL("Stamped patterns need sectors of at least {} bytes.", 2 * sizeof(SectorStamp));
+            return 1;
+        }
+        const DataPattern pattern(*patternKind, sectorSize, *seed, static_cast<unsigned char>(*fill));
+
+        const unsigned long long start = lba * sectorSize;
+        const unsigned long long end = start + *size;
+        const size_t block = static_cast<size_t>(std::min(*blockSize, *size));
+        IoEngine engine(device, block, static_cast<unsigned int>(std::min<unsigned long long>(*queueDepth, (*size + block - 1) / block)));
 
-        std::cout << "Wrote " << static_cast<DWORD>(size) << " bytes to LBA " << static_cast<DWORD>(lba) << std::endl;
+        // Raw output is written at each request's offset as it completes.
+        std::ofstream raw;
+        if (auto output = parser.get("output"); output && !write)
+        {
+            raw.open(path_from_utf8(*output), std::ios::binary | std::ios::trunc);
+            if (!raw)
+            {
+                LOG_FATAL("Failed to create {}", *output);
+                return 1;
+            }
+        }
+
+        // Completions arrive out of order; the dump is assembled by offset.
+        const bool dump = !write && !raw.is_open() && !verify && !parser.is_set("no-dump");
+        constexpr size_t maxReported = 32;
+        unsigned long long badSectors = 0;
+        std::vector<char> data(dump ? *size : 0);
+
+        unsigned long long cursor = start;
+        IoStats stats = engine.run(
+            [&](IoRequest &req)
+            {
+                if (cursor >= end)
+                    return false;
+                req.offset = cursor;
+                req.length = static_cast<size_t>(std::min<unsigned long long>(block, end - cursor));
+                req.write = write;
+                if (write)
+                {
+                    METRIC_TIMER("diskrw.fill_ns");
+                    pattern.fill(req.buffer, req.length, cursor / sectorSize);
+                }
+                cursor += req.length;
+                return true;
+            },
+            [&](const IoRequest &req, std::chrono::nanoseconds)
+            {
+                if (verify)
+                {
+                    METRIC_TIMER("diskrw.verify_ns");
+                    pattern.verify(req.buffer, req.transferred, req.offset / sectorSize, [&](uint64_t bad, const char *reason)
+                                   {
+                        if (badSectors < maxReported)
+                            LOG_ERROR("LBA {}: {}", bad, reason);
+                        else if (badSectors == maxReported)
+                            LOG_ERROR("More bad sectors follow; only the first {} are listed.", maxReported);
+                        ++badSectors; });
+                }
+                if (dump)
+                    std::memcpy(data.data() + (req.offset - start), req.buffer, req.transferred);
+                else if (raw.is_open())
+                {
+                    raw.seekp(static_cast<std::streamoff>(req.offset - start));
+                    raw.write(req.buffer, static_cast<std::streamsize>(req.transferred));
+                }
+            });
+
+        std::cout << (write ? "Wrote " : "Read ") << stats.bytes << (write ? " bytes to LBA " : " bytes from LBA ") << lba
+                  << " (" << sectorSize << "-byte sectors)" << std::endl;
+        std::cout << std::fixed << std::setprecision(2) << stats.ios << " requests of " << block << " bytes at queue depth "
+                  << engine.queue_depth() << " in " << stats.seconds * 1000 << " ms: " << stats.mb_per_sec() << " MB/s, "
+                  << stats.iops() << " IOPS" << std::endl;
+        if (verify)
+        {
+            std::cout << "Verified " << stats.bytes / sectorSize << " sectors: " << badSectors << " bad" << std::endl;
+            if (badSectors)
+                return 1;
+        }
+        if (raw.is_open())
+        {
+            raw.close();
+            if (!raw)
+            {
+                LOG_FATAL("Failed to write {}", parser.get("output").value());
+                return 1;
+            }
+        }
+        if (dump)
+            hexdump(data.data(), data.size(), stdout, parser.is_set("all"));
     }
-    else
+    catch (const std::system_error &e)
     {
-        std::cerr << "Invalid mode: " << mode << ". Use 'r' for read or 'w' for write." << std::endl;
+        LOG_FATAL("Error: {} (code: {})", e.what(), e.code().value());
+        return 1;
+    }
+    catch (const std::exception &e)
+    {
+        LOG_FATAL("Error: {}", e.what());
         return 1;
     }
-
-    CloseHandle(hDevice);
     return 0;
-}
\ No newline at end of file
+}
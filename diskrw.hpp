@@ -0,0 +1,169 @@
+#ifndef DISKRW_HPP
+#define DISKRW_HPP
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "blockio.hpp"
+
+// A raw disk (or file) opened for unbuffered, asynchronous I/O (FILE_FLAG_NO_BUFFERING / O_DIRECT).
+class Device
+{
+public:
+    Device(const std::string &path, bool writable)
+        : path_(path), handle_(blockio::open_file(path, (writable ? blockio::read_write : blockio::read_only) | blockio::direct | blockio::overlapped)),
+          geometry_(blockio::query_geometry(handle_, path))
+    {
+    }
+
+    native_handle_t handle() const { return handle_; }
+    const std::string &path() const { return path_; }
+    unsigned int logical_sector_size() const { return geometry_.logical_sector_size; }
+    unsigned int physical_sector_size() const { return geometry_.physical_sector_size; }
+    unsigned long long size() const { return geometry_.size; } // 0 if unknown
+
+private:
+    std::string path_;
+    blockio::Handle handle_;
+    blockio::Geometry geometry_;
+};
+
+// Maps a disk number to its device path ("\\.\PhysicalDriveN") on Windows and a bare device name
+// to its /dev node ("nvme0n1" -> "/dev/nvme0n1") on Linux unless such a file exists; anything else is used as given.
+std::string disk_path(const std::string &disk);
+
+// One transfer handled by IoEngine.
+struct IoRequest
+{
+    unsigned long long offset = 0; // bytes, sector aligned
+    size_t length = 0;             // bytes, sector aligned, at most the engine block size
+    bool write = false;
+    char *buffer = nullptr;        // aligned pool buffer of the engine block size
+    size_t transferred = 0;        // set on completion
+    std::chrono::steady_clock::time_point submitted;
+};
+
+struct IoStats
+{
+    unsigned long long bytes = 0;
+    unsigned long long ios = 0;
+    double seconds = 0;
+
+    double mb_per_sec() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0; }
+    double iops() const { return seconds > 0 ? ios / seconds : 0; }
+};
+
+// Keeps up to queue_depth requests in flight on one device (IOCP on Windows, native AIO on Linux).
+class IoEngine
+{
+public:
+    // Fills offset, length and write (and the buffer contents for writes). Returns false when there
+    // is nothing more to submit.
+    using Next = std::function<bool(IoRequest &)>;
+    // Called for every completed request, in completion order.
+    using Done = std::function<void(const IoRequest &, std::chrono::nanoseconds latency)>;
+
+    IoEngine(Device &device, size_t block_size, unsigned int queue_depth);
+    ~IoEngine();
+
+    IoEngine(const IoEngine &) = delete;
+    IoEngine &operator=(const IoEngine &) = delete;
+
+    // Runs until next returns false and every submitted request has completed. Throws
+    // std::system_error on the first failed transfer.
+    IoStats run(const Next &next, const Done &done);
+
+    size_t block_size() const { return block_size_; }
+    unsigned int queue_depth() const { return queue_depth_; }
+
+private:
+    struct Impl;
+
+    Device &device_;
+    size_t block_size_;
+    unsigned int queue_depth_;
+    blockio::BufferPool pool_;
+    std::unique_ptr<Impl> impl_;
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: 32 linear sub-buckets per power of
+// two, i.e. about 3% relative error. Recording is a couple of shifts and an increment, so every
+// worker keeps its own and they are merged once at the end.
+class LatencyHistogram
+{
+public:
+    void record(uint64_t value)
+    {
+        ++counts_[index_of(value)];
+        ++count_;
+        max_ = std::max(max_, value);
+        min_ = std::min(min_, value);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < buckets; ++i)
+            counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+        min_ = std::min(min_, other.min_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+
+    // Smallest recorded value v such that at least fraction q of the samples are <= v, reported as
+    // the upper end of its bucket (capped at the exact maximum).
+    uint64_t percentile(double q) const
+    {
+        if (count_ == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count_) + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, count_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets; ++i)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+                return std::min(highest_in_bucket(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr unsigned sub_bits = 5;
+    static constexpr uint64_t sub_count = 1ULL << sub_bits;
+    static constexpr size_t buckets = (64 - sub_bits + 1) * sub_count;
+
+    static size_t index_of(uint64_t value)
+    {
+        if (value < 2 * sub_count)
+            return static_cast<size_t>(value);
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - sub_bits;
+        return (shift + 1) * sub_count + static_cast<size_t>((value >> shift) - sub_count);
+    }
+
+    static uint64_t highest_in_bucket(size_t index)
+    {
+        if (index < 2 * sub_count)
+            return index;
+        unsigned shift = static_cast<unsigned>(index / sub_count - 1);
+        uint64_t sub = index % sub_count + sub_count;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_ = std::vector<uint64_t>(buckets);
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+    uint64_t min_ = UINT64_MAX;
+};
+
+#endif // DISKRW_HPP
@@ -0,0 +1,178 @@
+#include "diskrw.hpp"
+#include "metrics.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+std::string disk_path(const std::string &disk)
+{
+    // "nvme0n1" and "sdb" are shorthands for their /dev nodes, unless a file of that name is here.
+    if (!disk.empty() && disk.find('/') == std::string::npos && access(disk.c_str(), F_OK) != 0)
+        return "/dev/" + disk;
+    return disk;
+}
+
+// glibc has no wrappers for the native AIO syscalls.
+static long io_setup(unsigned int nr, aio_context_t *ctx) { return syscall(SYS_io_setup, nr, ctx); }
+static long io_destroy(aio_context_t ctx) { return syscall(SYS_io_destroy, ctx); }
+static long io_submit(aio_context_t ctx, long nr, struct iocb **iocbs) { return syscall(SYS_io_submit, ctx, nr, iocbs); }
+static long io_getevents(aio_context_t ctx, long min_nr, long nr, struct io_event *events)
+{
+    return syscall(SYS_io_getevents, ctx, min_nr, nr, events, nullptr);
+}
+
+// The iocb must stay at a fixed address while its request is in flight, so every queue slot
+// owns one together with its request.
+struct IoSlot
+{
+    struct iocb cb;
+    IoRequest request;
+};
+
+// Native AIO (io_submit) is asynchronous for O_DIRECT on block devices and most file systems.
+// Where the kernel lacks it, requests fall back to one pread/pwrite at a time.
+struct IoEngine::Impl
+{
+    aio_context_t ctx = 0;
+    bool aio = false;
+    std::vector<IoSlot> slots;
+};
+
+IoEngine::IoEngine(Device &device, size_t block_size, unsigned int queue_depth)
+    : device_(device), block_size_(block_size), queue_depth_(queue_depth), pool_(block_size, queue_depth), impl_(std::make_unique<Impl>())
+{
+    impl_->aio = io_setup(queue_depth_, &impl_->ctx) == 0;
+    impl_->slots.resize(queue_depth_);
+    for (IoSlot &slot : impl_->slots)
+        slot.request.buffer = pool_.acquire();
+}
+
+IoEngine::~IoEngine()
+{
+    for (IoSlot &slot : impl_->slots)
+        pool_.release(slot.request.buffer);
+    if (impl_->aio)
+        io_destroy(impl_->ctx);
+}
+
+IoStats IoEngine::run(const Next &next, const Done &done)
+{
+    IoStats stats;
+    int firstError = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    auto prepare = [&](IoSlot &slot) -> bool
+    {
+        char *buffer = slot.request.buffer;
+        slot.request = IoRequest{};
+        slot.request.buffer = buffer;
+        return firstError == 0 && next(slot.request);
+    };
+
+    if (!impl_->aio)
+    {
+        IoSlot &slot = impl_->slots.front();
+        while (prepare(slot))
+        {
+            slot.request.submitted = std::chrono::steady_clock::now();
+            if (slot.request.write)
+                METRIC_INC("diskrw.pwrite");
+            else
+                METRIC_INC("diskrw.pread");
+            ssize_t n = slot.request.write ? pwrite(device_.handle(), slot.request.buffer, slot.request.length, static_cast<off_t>(slot.request.offset))
+                                           : pread(device_.handle(), slot.request.buffer, slot.request.length, static_cast<off_t>(slot.request.offset));
+            if (n < 0)
+            {
+                firstError = errno;
+                break;
+            }
+            slot.request.transferred = static_cast<size_t>(n);
+            stats.bytes += static_cast<unsigned long long>(n);
+            ++stats.ios;
+            const auto latency = std::chrono::steady_clock::now() - slot.request.submitted;
+            METRIC_ADD("diskrw.bytes", n);
+            METRIC_RECORD("diskrw.latency_ns", std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+            done(slot.request, latency);
+        }
+    }
+    else
+    {
+        unsigned int inflight = 0;
+        auto submit = [&](IoSlot &slot) -> bool
+        {
+            if (!prepare(slot))
+                return false;
+            std::memset(&slot.cb, 0, sizeof(slot.cb));
+            slot.cb.aio_data = reinterpret_cast<uint64_t>(&slot);
+            slot.cb.aio_lio_opcode = slot.request.write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+            slot.cb.aio_fildes = static_cast<uint32_t>(device_.handle());
+            slot.cb.aio_buf = reinterpret_cast<uint64_t>(slot.request.buffer);
+            slot.cb.aio_nbytes = slot.request.length;
+            slot.cb.aio_offset = static_cast<int64_t>(slot.request.offset);
+            struct iocb *cbs[1] = {&slot.cb};
+            slot.request.submitted = std::chrono::steady_clock::now();
+            METRIC_INC("diskrw.io_submit");
+            if (io_submit(impl_->ctx, 1, cbs) != 1)
+            {
+                firstError = errno ? errno : EIO;
+                return false;
+            }
+            ++inflight;
+            return true;
+        };
+
+        for (IoSlot &slot : impl_->slots)
+        {
+            if (!submit(slot))
+                break;
+        }
+
+        std::vector<struct io_event> events(queue_depth_);
+        while (inflight > 0)
+        {
+            long n = io_getevents(impl_->ctx, 1, static_cast<long>(events.size()), events.data());
+            METRIC_INC("diskrw.io_getevents");
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "io_getevents failed");
+            }
+            for (long i = 0; i < n; ++i)
+            {
+                --inflight;
+                IoSlot &slot = *reinterpret_cast<IoSlot *>(events[i].data);
+                if (events[i].res < 0)
+                {
+                    // Let the other requests drain before reporting.
+                    if (firstError == 0)
+                        firstError = static_cast<int>(-events[i].res);
+                    continue;
+                }
+                slot.request.transferred = static_cast<size_t>(events[i].res);
+                stats.bytes += static_cast<unsigned long long>(events[i].res);
+                ++stats.ios;
+                const auto latency = std::chrono::steady_clock::now() - slot.request.submitted;
+                METRIC_ADD("diskrw.bytes", events[i].res);
+                METRIC_RECORD("diskrw.latency_ns", std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+                done(slot.request, latency);
+                submit(slot);
+            }
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (firstError != 0)
+    {
+        throw std::system_error(firstError, std::generic_category(), "I/O on " + device_.path() + " failed");
+    }
+    return stats;
+}
+
+#endif // _WIN32
@@ -0,0 +1,134 @@
+#include "diskrw.hpp"
+#include "metrics.hpp"
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <system_error>
+
+std::string disk_path(const std::string &disk)
+{
+    if (!disk.empty() && std::all_of(disk.begin(), disk.end(), [](unsigned char c)
+                                     { return std::isdigit(c); }))
+        return "\\\\.\\PhysicalDrive" + disk;
+    return disk;
+}
+
+// An OVERLAPPED must stay at a fixed address while its request is in flight, so every queue slot
+// owns one together with its request.
+struct IoSlot
+{
+    OVERLAPPED overlapped;
+    IoRequest request;
+};
+
+struct IoEngine::Impl
+{
+    HANDLE port = NULL;
+    std::vector<IoSlot> slots;
+};
+
+IoEngine::IoEngine(Device &device, size_t block_size, unsigned int queue_depth)
+    : device_(device), block_size_(block_size), queue_depth_(queue_depth), pool_(block_size, queue_depth), impl_(std::make_unique<Impl>())
+{
+    impl_->port = CreateIoCompletionPort(device_.handle(), NULL, 0, 1);
+    if (!impl_->port)
+    {
+        throw std::system_error(GetLastError(), std::system_category(), "CreateIoCompletionPort failed");
+    }
+    impl_->slots.resize(queue_depth_);
+    for (IoSlot &slot : impl_->slots)
+        slot.request.buffer = pool_.acquire();
+}
+
+IoEngine::~IoEngine()
+{
+    for (IoSlot &slot : impl_->slots)
+        pool_.release(slot.request.buffer);
+    if (impl_->port)
+        CloseHandle(impl_->port);
+}
+
+IoStats IoEngine::run(const Next &next, const Done &done)
+{
+    IoStats stats;
+    unsigned int inflight = 0;
+    DWORD firstError = ERROR_SUCCESS;
+
+    // Returns false once next() runs dry or a request failed to start.
+    auto submit = [&](IoSlot &slot) -> bool
+    {
+        char *buffer = slot.request.buffer;
+        slot.request = IoRequest{};
+        slot.request.buffer = buffer;
+        if (firstError != ERROR_SUCCESS || !next(slot.request))
+            return false;
+
+        ZeroMemory(&slot.overlapped, sizeof(slot.overlapped));
+        slot.overlapped.Offset = static_cast<DWORD>(slot.request.offset);
+        slot.overlapped.OffsetHigh = static_cast<DWORD>(slot.request.offset >> 32);
+        slot.request.submitted = std::chrono::steady_clock::now();
+        METRIC_INC("diskrw.submit");
+        BOOL ok = slot.request.write
+                      ? WriteFile(device_.handle(), buffer, static_cast<DWORD>(slot.request.length), NULL, &slot.overlapped)
+                      : ReadFile(device_.handle(), buffer, static_cast<DWORD>(slot.request.length), NULL, &slot.overlapped);
+        DWORD error = ok ? ERROR_SUCCESS : GetLastError();
+        if (error != ERROR_SUCCESS && error != ERROR_IO_PENDING)
+        {
+            firstError = error;
+            return false;
+        }
+        // Even synchronous completions are queued to the port.
+        ++inflight;
+        return true;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (IoSlot &slot : impl_->slots)
+    {
+        if (!submit(slot))
+            break;
+    }
+
+    while (inflight > 0)
+    {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED *overlapped = NULL;
+        BOOL ok = GetQueuedCompletionStatus(impl_->port, &bytes, &key, &overlapped, INFINITE);
+        METRIC_INC("diskrw.completion_wait");
+        if (!overlapped)
+        {
+            throw std::system_error(GetLastError(), std::system_category(), "GetQueuedCompletionStatus failed");
+        }
+        --inflight;
+
+        IoSlot &slot = *CONTAINING_RECORD(overlapped, IoSlot, overlapped);
+        if (!ok)
+        {
+            // Let the other requests drain before reporting.
+            if (firstError == ERROR_SUCCESS)
+                firstError = GetLastError();
+            continue;
+        }
+        slot.request.transferred = bytes;
+        stats.bytes += bytes;
+        ++stats.ios;
+        const auto latency = std::chrono::steady_clock::now() - slot.request.submitted;
+        METRIC_ADD("diskrw.bytes", bytes);
+        METRIC_RECORD("diskrw.latency_ns", std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        done(slot.request, latency);
+        submit(slot);
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (firstError != ERROR_SUCCESS)
+    {
+        throw std::system_error(firstError, std::system_category(), "I/O on " + device_.path() + " failed");
+    }
+    return stats;
+}
+
+#endif // _WIN32
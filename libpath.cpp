@@ -1,47 +1,48 @@
+#include "blockio.hpp"
+#include "metrics.hpp"
 #include <filesystem>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <sstream>
 #include <iomanip>
 #include <optional>
 #include <type_traits>
 #include <algorithm>
 #include <set>
+#include <chrono>
+#include <cerrno>
+#include <system_error>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <functional>
+#include <cstring>
+#include <fstream>
+#include <string_view>
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <linux/fs.h>
 #endif
 
 namespace fs = std::filesystem;
 
-#ifdef _WIN32
-using os_string_t = std::wstring;
-#else
-using os_string_t = std::string;
-#endif
-
-#ifdef _WIN32
-static os_string_t from_utf8(const std::string &s)
-{
-    if (s.empty())
-        return {};
-    int size_needed = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), NULL, 0);
-    if (size_needed <= 0)
-        return {};
-    std::wstring wstr(size_needed, 0);
-    MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), &wstr[0], size_needed);
-    return wstr;
-}
-#else
-static os_string_t from_utf8(const std::string &s)
-{
-    return s;
-}
-#endif
-
 static void print_path_pair(const fs::path &oldp, const fs::path &newp)
 {
     std::cout << reinterpret_cast<const char *>(oldp.u8string().c_str())
@@ -61,44 +62,992 @@ static std::string pad_num(int n, int width = 6)
     return oss.str();
 }
 
+// ------------------------
+// copy backend: reflink / copy_file_range / CopyFileExW, falling back to a plain stream copy
+// ------------------------
+enum class CopyMethod
+{
+    None,          // not copied (skipped or failed)
+    Reflink,       // FICLONE: shares extents, no data is moved
+    CopyFileRange, // in-kernel copy, no user-space buffers
+    CopyFileEx,    // CopyFileExW, buffered
+    CopyFileExNoBuffering,
+    Stream,        // read/write loop
+};
+
+static const char *copy_method_name(CopyMethod m)
+{
+    switch (m)
+    {
+    case CopyMethod::Reflink:
+        return "reflink";
+    case CopyMethod::CopyFileRange:
+        return "copy_file_range";
+    case CopyMethod::CopyFileEx:
+        return "CopyFileEx";
+    case CopyMethod::CopyFileExNoBuffering:
+        return "CopyFileEx/no-buffering";
+    case CopyMethod::Stream:
+        return "stream";
+    default:
+        return "none";
+    }
+}
+
+struct CopyResult
+{
+    CopyMethod method = CopyMethod::None;
+    bool skipped = false; // destination already existed (skip_existing semantics)
+    uintmax_t bytes = 0;    // actually copied
+    uintmax_t expected = 0; // source size when the copy started
+    bool shrank = false;    // the source got shorter while it was copied (ec is set)
+    double seconds = 0;
+    std::error_code ec;
+};
+
+// Files at least this large are copied without the system cache on Windows.
+static constexpr uintmax_t NO_BUFFERING_THRESHOLD = 64ull << 20;
+
+#ifdef _WIN32
+static CopyResult copy_file_fast(const fs::path &from, const fs::path &to)
+{
+    METRIC_TIMER("libpath.copy_ns");
+    CopyResult r;
+    auto start = std::chrono::steady_clock::now();
+    std::error_code ec;
+    uintmax_t size = fs::file_size(from, ec);
+    if (ec)
+    {
+        r.ec = ec;
+        return r;
+    }
+    r.expected = size;
+
+    DWORD flags = COPY_FILE_FAIL_IF_EXISTS;
+    r.method = CopyMethod::CopyFileEx;
+    if (size >= NO_BUFFERING_THRESHOLD)
+    {
+        flags |= COPY_FILE_NO_BUFFERING;
+        r.method = CopyMethod::CopyFileExNoBuffering;
+    }
+    BOOL ok = CopyFileExW(from.c_str(), to.c_str(), NULL, NULL, NULL, flags);
+    if (!ok && (flags & COPY_FILE_NO_BUFFERING) && GetLastError() == ERROR_INVALID_PARAMETER)
+    {
+        // Some file systems (network shares, FAT) reject unbuffered copies.
+        ok = CopyFileExW(from.c_str(), to.c_str(), NULL, NULL, NULL, COPY_FILE_FAIL_IF_EXISTS);
+        r.method = CopyMethod::CopyFileEx;
+    }
+    if (!ok)
+    {
+        DWORD err = GetLastError();
+        r.method = CopyMethod::None;
+        if (err == ERROR_FILE_EXISTS)
+            r.skipped = true;
+        else
+            r.ec = std::error_code(static_cast<int>(err), std::system_category());
+        return r;
+    }
+    r.bytes = size;
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+#else
+// Returns false with errno set; EXDEV/ENOSYS/EOPNOTSUPP/EINVAL before any byte moved mean
+// "not supported here" and make the caller fall back. done stops short of size if the source shrank.
+static bool copy_range_all(int in, int out, uintmax_t size, bool &started, uintmax_t &done)
+{
+    done = 0;
+    while (done < size)
+    {
+        METRIC_INC("libpath.copy_file_range");
+        ssize_t n = copy_file_range(in, nullptr, out, nullptr, size - done, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (n == 0)
+            break; // source shrank
+        started = true;
+        done += static_cast<uintmax_t>(n);
+    }
+    return true;
+}
+
+static bool stream_copy(int in, int out, uintmax_t &done)
+{
+    done = 0;
+    std::vector<char> buf(1 << 20);
+    while (true)
+    {
+        METRIC_INC("libpath.read");
+        ssize_t n = read(in, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return true;
+        for (ssize_t off = 0; off < n;)
+        {
+            METRIC_INC("libpath.write");
+            ssize_t w = write(out, buf.data() + off, static_cast<size_t>(n - off));
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0)
+                return false;
+            off += w;
+            done += static_cast<uintmax_t>(w);
+        }
+    }
+}
+
+static CopyResult copy_file_fast(const fs::path &from, const fs::path &to)
+{
+    METRIC_TIMER("libpath.copy_ns");
+    CopyResult r;
+    auto start = std::chrono::steady_clock::now();
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        r.ec = std::error_code(errno, std::generic_category());
+        return r;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0)
+    {
+        r.ec = std::error_code(errno, std::generic_category());
+        close(in);
+        return r;
+    }
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0)
+    {
+        if (errno == EEXIST)
+            r.skipped = true;
+        else
+            r.ec = std::error_code(errno, std::generic_category());
+        close(in);
+        return r;
+    }
+
+    const uintmax_t size = static_cast<uintmax_t>(st.st_size);
+    r.expected = size;
+    bool ok = false;
+    METRIC_INC("libpath.ficlone");
+    if (ioctl(out, FICLONE, in) == 0)
+    {
+        r.method = CopyMethod::Reflink;
+        struct stat cloned;
+        r.bytes = fstat(out, &cloned) == 0 ? static_cast<uintmax_t>(cloned.st_size) : size;
+        ok = true;
+    }
+    else
+    {
+        bool started = false;
+        if (copy_range_all(in, out, size, started, r.bytes))
+        {
+            r.method = CopyMethod::CopyFileRange;
+            ok = true;
+        }
+        else if (!started && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+        {
+            ok = stream_copy(in, out, r.bytes);
+            r.method = CopyMethod::Stream;
+        }
+    }
+    if (ok && r.bytes < size)
+    {
+        // The source was truncated while we copied it; the partial copy is not kept.
+        ok = false;
+        r.shrank = true;
+        errno = EIO;
+    }
+    if (ok)
+        fchmod(out, st.st_mode & 07777); // the umask applied at open()
+    else
+        r.ec = std::error_code(errno, std::generic_category());
+    if (close(out) != 0 && ok)
+    {
+        ok = false;
+        r.ec = std::error_code(errno, std::generic_category());
+    }
+    close(in);
+
+    if (!ok)
+    {
+        r.method = CopyMethod::None;
+        unlink(to.c_str());
+        return r;
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return r;
+}
+#endif
+
+// Copy workers print concurrently; every line goes out under this lock.
+static std::mutex g_print_mutex;
+
+static void print_copy_result(const fs::path &dest, const CopyResult &r)
+{
+    std::ostringstream oss;
+    oss << "    [" << copy_method_name(r.method) << ", " << r.bytes << " bytes";
+    if (r.seconds > 0)
+        oss << ", " << std::fixed << std::setprecision(1) << r.bytes / r.seconds / (1024.0 * 1024.0) << " MB/s";
+    oss << "] " << reinterpret_cast<const char *>(dest.filename().u8string().c_str()) << "\n";
+    std::lock_guard<std::mutex> lock(g_print_mutex);
+    std::cout << oss.str();
+}
+
+// ------------------------
+// pipeline plumbing
+// ------------------------
+// Blocking FIFO with a capacity, so a fast stage cannot run arbitrarily far ahead of a slow one.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&]
+                       { return items_.size() < capacity_; });
+        items_.push_back(std::move(value));
+        not_empty_.notify_one();
+    }
+
+    // Returns nullopt once the queue is closed and drained.
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&]
+                        { return !items_.empty() || closed_; });
+        if (items_.empty())
+            return std::nullopt;
+        T value = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+// Identifies the device a path lives on, so copies can be limited per device.
+static std::string device_key(const fs::path &p)
+{
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH];
+    if (GetVolumePathNameW(p.c_str(), volume, MAX_PATH))
+        return reinterpret_cast<const char *>(fs::path(volume).u8string().c_str());
+    return {};
+#else
+    struct stat st;
+    if (stat(p.c_str(), &st) != 0)
+        return {};
+    return std::to_string(static_cast<unsigned long long>(st.st_dev));
+#endif
+}
+
+// Counting semaphore per device key; a copy holds a slot on its source and its destination
+// device. Slots are always taken in key order, so two copies cannot deadlock on each other.
+class DeviceLimiter
+{
+public:
+    explicit DeviceLimiter(int per_device) : limit_(per_device) {}
+
+    void acquire(const std::string &a, const std::string &b)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto keys = ordered(a, b);
+        for (const auto &k : keys)
+        {
+            if (k.empty())
+                continue;
+            cv_.wait(lock, [&]
+                     { return active_[k] < limit_; });
+            ++active_[k];
+        }
+    }
+
+    void release(const std::string &a, const std::string &b)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &k : ordered(a, b))
+        {
+            if (!k.empty())
+                --active_[k];
+        }
+        cv_.notify_all();
+    }
+
+private:
+    static std::vector<std::string> ordered(const std::string &a, const std::string &b)
+    {
+        if (a == b)
+            return {a};
+        return a < b ? std::vector<std::string>{a, b} : std::vector<std::string>{b, a};
+    }
+
+    int limit_;
+    std::map<std::string, int> active_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+struct CopyJob
+{
+    fs::path from;
+    fs::path to;
+    std::string from_device;
+};
+
 struct Config
 {
     fs::path source_dir = fs::current_path();
     fs::path dest_dir;
     bool dry_run = false;
+    int jobs = 4;           // copy workers
+    int per_device = 2;     // concurrent copies touching one device
+    int iterations = 10;    // rounds before giving up
+    int sleep_seconds = 5;  // pause between rounds
+    bool watch = false;     // copy new files as they appear instead of polling
+    bool use_index = false; // keep the destination's names in a NameStore
+    bool recursive = false; // take files from the whole source tree, flattened into dest_dir
+    std::string metrics;    // "step" or "json": log per-phase timings and counters
+    int metrics_interval = 0; // seconds between metric dumps (0: only at exit)
+};
+
+struct NameEntry
+{
+    bool plain_used = false;
+    int next_tag = 0; // no free tag below this one
+    std::unordered_set<int> tags;
+};
+
+// The destination's NameIndex kept in the destination itself (.libpath-index), so a cold start
+// need not list a directory of millions of files. The file is a snapshot of the entries sorted
+// by key, mapped read-only and binary-searched in place, followed by a journal of the names taken
+// since. It is trusted only while the directory's mtime is the one recorded after our last change.
+// Keys are stored in native code units, so the file belongs to the platform that wrote it.
+class NameStore
+{
+public:
+    static constexpr const char *file_name = ".libpath-index";
+
+    // The index file and its temporary are never copied or indexed themselves.
+    static bool owns(const fs::path &p)
+    {
+        auto name = p.filename();
+        return name == file_name || name == std::string(file_name) + ".tmp";
+    }
+
+    explicit NameStore(const fs::path &dir) : dir_(dir), path_(dir / file_name) { load(); }
+    ~NameStore() { unmap(); }
+
+    NameStore(const NameStore &) = delete;
+    NameStore &operator=(const NameStore &) = delete;
+
+    bool valid() const { return valid_; }
+
+    bool find(const os_string_t &key, NameEntry &e) const
+    {
+        if (!valid_)
+            return false;
+        uint64_t lo = 0, hi = header_.count;
+        while (lo < hi)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (key_at(record_at(mid)) < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == header_.count)
+            return false;
+        Record r = record_at(lo);
+        if (key_at(r) != key)
+            return false;
+        e.plain_used = r.plain_used != 0;
+        e.next_tag = r.next_tag;
+        for (uint32_t i = 0; i < r.tag_count; ++i)
+            e.tags.insert(tag_at(r.tag_first + i));
+        return true;
+    }
+
+    // Names taken since the snapshot was written.
+    std::vector<os_string_t> journal() const
+    {
+        std::vector<os_string_t> names;
+        if (!valid_)
+            return names;
+        for (uint64_t off = header_.journal; off + sizeof(uint32_t) <= size_;)
+        {
+            uint32_t len;
+            std::memcpy(&len, data_ + off, sizeof(len));
+            off += sizeof(len);
+            if (off + uint64_t(len) * sizeof(char_t) > size_)
+                break; // torn by a crash
+            os_string_t name(len, char_t{});
+            std::memcpy(name.data(), data_ + off, len * sizeof(char_t));
+            off += len * sizeof(char_t);
+            names.push_back(std::move(name));
+        }
+        return names;
+    }
+
+    void record(const os_string_t &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!valid_)
+            return;
+        if (!log_.is_open())
+            log_.open(path_, std::ios::binary | std::ios::app);
+        uint32_t len = static_cast<uint32_t>(name.size());
+        log_.write(reinterpret_cast<const char *>(&len), sizeof(len));
+        log_.write(reinterpret_cast<const char *>(name.data()), len * sizeof(char_t));
+        log_.flush();
+        ++journal_count_;
+    }
+
+    // Records the directory's current mtime, vouching that every name in it is in the index.
+    void stamp()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (valid_)
+            write_mtime(invalidated_ ? 0 : current_mtime());
+    }
+
+    // The directory held a name the index did not; the next start lists it again.
+    void invalidate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        invalidated_ = true;
+        if (valid_)
+            write_mtime(0);
+    }
+
+    bool needs_compaction() const
+    {
+        return !valid_ || journal_count_ > std::max<uint64_t>(65536, header_.count / 8);
+    }
+
+    // Rewrites the file as one snapshot: the current one overridden by entries, without a journal.
+    void compact(const std::unordered_map<os_string_t, NameEntry> &entries)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<os_string_t, NameEntry>> all;
+        if (valid_)
+        {
+            for (uint64_t i = 0; i < header_.count; ++i)
+            {
+                os_string_t key(key_at(record_at(i)));
+                if (entries.count(key))
+                    continue;
+                NameEntry e;
+                find(key, e);
+                all.emplace_back(std::move(key), std::move(e));
+            }
+        }
+        for (const auto &[key, e] : entries)
+        {
+            if (e.plain_used || !e.tags.empty())
+                all.emplace_back(key, e);
+        }
+        std::sort(all.begin(), all.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+
+        std::vector<Record> records;
+        std::vector<char_t> strings;
+        std::vector<int32_t> tags;
+        records.reserve(all.size());
+        for (auto &[key, e] : all)
+        {
+            // Every tag below next_tag is taken, so only the ones above it need storing.
+            int next = e.next_tag;
+            while (e.tags.count(next))
+                ++next;
+            Record r{strings.size(), static_cast<uint32_t>(key.size()), e.plain_used ? 1u : 0u, next, 0, tags.size()};
+            strings.insert(strings.end(), key.begin(), key.end());
+            std::vector<int32_t> above;
+            for (int t : e.tags)
+                if (t > next)
+                    above.push_back(t);
+            std::sort(above.begin(), above.end());
+            tags.insert(tags.end(), above.begin(), above.end());
+            r.tag_count = static_cast<uint32_t>(above.size());
+            records.push_back(r);
+        }
+
+        Header h{};
+        std::memcpy(h.magic, magic, sizeof(h.magic));
+        h.unit_size = sizeof(char_t);
+        h.count = records.size();
+        h.records = sizeof(Header);
+        h.strings = h.records + records.size() * sizeof(Record);
+        h.tags = align4(h.strings + strings.size() * sizeof(char_t));
+        h.journal = h.tags + tags.size() * sizeof(int32_t);
+
+        fs::path tmp = path_;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            const char pad[4] = {};
+            out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+            out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Record));
+            out.write(reinterpret_cast<const char *>(strings.data()), strings.size() * sizeof(char_t));
+            out.write(pad, h.tags - (h.strings + strings.size() * sizeof(char_t)));
+            out.write(reinterpret_cast<const char *>(tags.data()), tags.size() * sizeof(int32_t));
+            if (!out.flush())
+            {
+                print_error_msg("Failed to write " + std::string(reinterpret_cast<const char *>(tmp.u8string().c_str())));
+                return;
+            }
+        }
+
+        // A mapped file cannot be replaced on Windows.
+        unmap();
+        log_.close();
+        std::error_code ec;
+        fs::rename(tmp, path_, ec);
+        if (ec)
+        {
+            print_error_msg("Failed to replace the name index: " + ec.message());
+            fs::remove(tmp, ec);
+            return;
+        }
+        write_mtime(current_mtime());
+        load();
+    }
+
+private:
+    using char_t = typename os_string_t::value_type;
+    static constexpr char magic[8] = {'L', 'P', 'N', 'A', 'M', 'E', 'S', '1'};
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t unit_size; // sizeof(os_string_t::value_type) of the writer
+        uint32_t reserved;
+        int64_t dir_mtime;  // 0 = stale
+        uint64_t count;
+        uint64_t records;   // byte offsets of the areas
+        uint64_t strings;
+        uint64_t tags;
+        uint64_t journal;   // appended records (uint32 length, name) up to the end of the file
+    };
+    static_assert(sizeof(Header) == 64);
+
+    struct Record
+    {
+        uint64_t key;       // into the string area, in code units
+        uint32_t key_len;
+        uint32_t plain_used;
+        int32_t next_tag;
+        uint32_t tag_count;
+        uint64_t tag_first; // into the tag area, in tags
+    };
+    static_assert(sizeof(Record) == 32);
+
+    static uint64_t align4(uint64_t v) { return (v + 3) & ~uint64_t(3); }
+
+    Record record_at(uint64_t i) const
+    {
+        Record r;
+        std::memcpy(&r, data_ + header_.records + i * sizeof(Record), sizeof(r));
+        return r;
+    }
+
+    std::basic_string_view<char_t> key_at(const Record &r) const
+    {
+        return {reinterpret_cast<const char_t *>(data_ + header_.strings) + r.key, r.key_len};
+    }
+
+    int tag_at(uint64_t i) const
+    {
+        int32_t t;
+        std::memcpy(&t, data_ + header_.tags + i * sizeof(t), sizeof(t));
+        return t;
+    }
+
+    // Every record's key and tags must lie inside their areas; a truncated or corrupt file is
+    // treated as stale rather than read out of bounds.
+    bool records_in_bounds() const
+    {
+        const uint64_t units = (header_.tags - header_.strings) / sizeof(char_t);
+        const uint64_t tags = (header_.journal - header_.tags) / sizeof(int32_t);
+        for (uint64_t i = 0; i < header_.count; ++i)
+        {
+            Record r = record_at(i);
+            if (r.key > units || r.key_len > units - r.key || r.tag_first > tags || r.tag_count > tags - r.tag_first)
+                return false;
+        }
+        return true;
+    }
+
+    int64_t current_mtime() const
+    {
+        std::error_code ec;
+        auto t = fs::last_write_time(dir_, ec);
+        return ec ? 0 : static_cast<int64_t>(t.time_since_epoch().count());
+    }
+
+    // Rewriting the file's contents leaves the directory's mtime alone.
+    void write_mtime(int64_t mtime)
+    {
+        std::fstream f(path_, std::ios::binary | std::ios::in | std::ios::out);
+        if (!f)
+            return;
+        f.seekp(offsetof(Header, dir_mtime));
+        f.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+    }
+
+    void load()
+    {
+        valid_ = false;
+        journal_count_ = 0;
+        map();
+        if (size_ < sizeof(Header))
+            return unmap();
+        std::memcpy(&header_, data_, sizeof(header_));
+        const Header &h = header_;
+        bool sane = std::memcmp(h.magic, magic, sizeof(magic)) == 0 && h.unit_size == sizeof(char_t) &&
+                    h.records == sizeof(Header) && h.count <= (size_ - sizeof(Header)) / sizeof(Record) &&
+                    h.strings == h.records + h.count * sizeof(Record) && h.strings <= h.tags && h.tags % 4 == 0 &&
+                    h.tags <= h.journal && h.journal <= size_;
+        if (!sane || h.dir_mtime == 0 || h.dir_mtime != current_mtime() || !records_in_bounds())
+            return unmap();
+        valid_ = true;
+        journal_count_ = journal().size();
+    }
+
+#ifdef _WIN32
+    void map()
+    {
+        HANDLE file = CreateFileW(path_.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+            {
+                if (void *p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+                {
+                    data_ = static_cast<const char *>(p);
+                    size_ = static_cast<uint64_t>(size.QuadPart);
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+
+    void unmap()
+    {
+        if (data_)
+            UnmapViewOfFile(data_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+#else
+    void map()
+    {
+        int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = static_cast<const char *>(p);
+                size_ = static_cast<uint64_t>(st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    void unmap()
+    {
+        if (data_)
+            munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+#endif
+
+    fs::path dir_;
+    fs::path path_;
+    const char *data_ = nullptr;
+    uint64_t size_ = 0;
+    Header header_{};
+    bool valid_ = false;
+    bool invalidated_ = false;
+    uint64_t journal_count_ = 0;
+    std::ofstream log_;
+    std::mutex mutex_;
 };
 
-static std::vector<fs::path> collect_files(const fs::path &dir)
-{
-    std::vector<fs::path> paths;
-    paths.reserve(128);
-    std::error_code ec;
-    for (auto &e : fs::directory_iterator(dir, ec))
+static std::vector<fs::path> collect_files(const fs::path &dir)
+{
+    std::vector<fs::path> paths;
+    paths.reserve(128);
+    std::error_code ec;
+    for (auto &e : fs::directory_iterator(dir, ec))
+    {
+        if (ec)
+        {
+            print_error_msg("Error iterating source directory: " + ec.message());
+            break;
+        }
+        std::error_code type_ec; // a dangling link must not end the listing
+        if (!e.is_regular_file(type_ec) || NameStore::owns(e.path()))
+            continue;
+        paths.push_back(e.path());
+    }
+    return paths;
+}
+
+static std::vector<fs::path> collect_sorted_files(const fs::path &dir)
+{
+    auto paths = collect_files(dir);
+    std::sort(paths.begin(), paths.end(), [](const fs::path &a, const fs::path &b)
+              {
+#ifdef _WIN32
+                  return a.wstring() < b.wstring();
+#else
+                  return a.string() < b.string();
+#endif
+              });
+    return paths;
+}
+
+// Lists every regular file below root on several threads and hands each to on_file (from any of
+// them) as soon as it is found, so copying starts long before a deep tree is fully listed. Every
+// thread works depth-first on its own stack of directories, which keeps the pending set small,
+// and steals the oldest (topmost, so usually largest) directory of another when it runs dry.
+// Symbolic links to directories are not followed; skip (if not empty) is left out.
+class TreeWalker
+{
+public:
+    using OnFile = std::function<void(fs::path)>;
+
+    TreeWalker(int threads, const fs::path &skip, OnFile on_file)
+        : stacks_(std::max(1, threads)), skip_(skip), on_file_(std::move(on_file))
+    {
+    }
+
+    void walk(const fs::path &root)
+    {
+        push(0, root);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < stacks_.size(); ++i)
+            threads.emplace_back([this, i]
+                                 { run(i); });
+        for (auto &t : threads)
+            t.join();
+    }
+
+private:
+    struct Stack
+    {
+        std::mutex mutex;
+        std::deque<fs::path> dirs;
+    };
+
+    void push(size_t self, fs::path dir)
+    {
+        ++pending_;
+        {
+            std::lock_guard<std::mutex> lock(stacks_[self].mutex);
+            stacks_[self].dirs.push_back(std::move(dir));
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+        }
+        idle_cv_.notify_one();
+    }
+
+    std::optional<fs::path> take(size_t self)
+    {
+        {
+            Stack &own = stacks_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.dirs.empty())
+            {
+                fs::path dir = std::move(own.dirs.back());
+                own.dirs.pop_back();
+                return dir;
+            }
+        }
+        for (size_t k = 1; k < stacks_.size(); ++k)
+        {
+            Stack &victim = stacks_[(self + k) % stacks_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.dirs.empty())
+            {
+                fs::path dir = std::move(victim.dirs.front());
+                victim.dirs.pop_front();
+                return dir;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void run(size_t self)
     {
-        if (ec)
+        for (;;)
         {
-            print_error_msg("Error iterating source directory: " + ec.message());
-            break;
+            if (auto dir = take(self))
+            {
+                list(self, *dir);
+                if (--pending_ == 0)
+                {
+                    std::lock_guard<std::mutex> lock(idle_mutex_);
+                    idle_cv_.notify_all();
+                }
+                continue;
+            }
+            // Directories still being listed may yet push more work.
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            if (pending_ == 0)
+                return;
+            idle_cv_.wait_for(lock, std::chrono::milliseconds(10));
         }
-        if (!e.is_regular_file(ec))
-            continue;
-        paths.push_back(e.path());
     }
-    return paths;
-}
 
-static std::vector<fs::path> collect_sorted_files(const fs::path &dir)
-{
-    auto paths = collect_files(dir);
-    std::sort(paths.begin(), paths.end(), [](const fs::path &a, const fs::path &b)
-              {
+    void subdirectory(size_t self, fs::path dir)
+    {
+        if (!skip_.empty() && dir == skip_)
+            return;
+        push(self, std::move(dir));
+    }
+
 #ifdef _WIN32
-                  return a.wstring() < b.wstring();
+    void list(size_t self, const fs::path &dir)
+    {
+        WIN32_FIND_DATAW data;
+        HANDLE find = FindFirstFileExW((dir / L"*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE)
+        {
+            if (GetLastError() != ERROR_FILE_NOT_FOUND)
+                print_error_msg("Error listing " + std::string(reinterpret_cast<const char *>(dir.u8string().c_str())) + ": " +
+                                std::system_category().message(GetLastError()));
+            return;
+        }
+        do
+        {
+            const wchar_t *name = data.cFileName;
+            if (name[0] == L'.' && (name[1] == 0 || (name[1] == L'.' && name[2] == 0)))
+                continue;
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                    subdirectory(self, dir / name);
+            }
+            else if (!NameStore::owns(name))
+            {
+                on_file_(dir / name);
+            }
+        } while (FindNextFileW(find, &data));
+        FindClose(find);
+    }
 #else
-                  return a.string() < b.string();
+    struct linux_dirent64
+    {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    void list(size_t self, const fs::path &dir)
+    {
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            print_error_msg("Error listing " + dir.string() + ": " + std::generic_category().message(errno));
+            return;
+        }
+        alignas(linux_dirent64) char buf[64 * 1024];
+        for (;;)
+        {
+            METRIC_INC("libpath.getdents64");
+            long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+            if (n <= 0)
+            {
+                if (n < 0)
+                    print_error_msg("Error listing " + dir.string() + ": " + std::generic_category().message(errno));
+                break;
+            }
+            for (long off = 0; off < n;)
+            {
+                auto *d = reinterpret_cast<linux_dirent64 *>(buf + off);
+                off += d->d_reclen;
+                const char *name = d->d_name;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+                    continue;
+                unsigned char type = d->d_type;
+                if (type == DT_UNKNOWN || type == DT_LNK)
+                {
+                    // Links count as what they point to, except that directories are not entered.
+                    struct stat st;
+                    bool link = type == DT_LNK;
+                    if (fstatat(fd, name, &st, link ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+                        continue;
+                    type = S_ISREG(st.st_mode) ? DT_REG : (S_ISDIR(st.st_mode) && !link) ? DT_DIR : DT_UNKNOWN;
+                }
+                // An index left by --index in any visited directory is ours, not input.
+                if (type == DT_REG)
+                {
+                    if (!NameStore::owns(name))
+                        on_file_(dir / name);
+                }
+                else if (type == DT_DIR)
+                    subdirectory(self, dir / name);
+            }
+        }
+        close(fd);
+    }
 #endif
-              });
-    return paths;
+
+    std::vector<Stack> stacks_;
+    fs::path skip_;
+    OnFile on_file_;
+    std::atomic<int> pending_{0}; // directories queued or being listed
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+};
+
+// The directory under root that the walk must leave out because the copies go there, if any.
+static fs::path walk_skip(const fs::path &root, const fs::path &dest)
+{
+    std::error_code ec;
+    fs::path rel = fs::absolute(dest, ec).lexically_normal().lexically_relative(fs::absolute(root, ec).lexically_normal());
+    if (rel.empty() || rel == "." || *rel.begin() == "..")
+        return {};
+    return root / rel;
 }
 
 static std::optional<int> extract_trailing_number_tag(const os_string_t &stem)
@@ -175,60 +1124,621 @@ static os_string_t path_ext_generic(const fs::path &p)
 #endif
 }
 
+// Destination names in use, grouped by "stem/ext" (the separator cannot occur in a file name).
+// A name "S[NNNNNN]E" is recorded twice: as the untagged name of stem "S[NNNNNN]" and as tag N
+// of stem "S", which is exactly what probing S+E, S[000000]+E, S[000001]+E, ... would hit. That
+// makes an assignment a hash lookup plus an increment instead of building and comparing a path
+// per probe. Copy workers reassign names that turn out to be taken, so every call locks.
+class NameIndex
+{
+public:
+    // Backs the index by store: keys not seen yet are looked up in its snapshot, its journal is
+    // replayed, and, if record is set, every name taken from now on is appended to it.
+    void attach(NameStore &store, bool record)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        store_ = &store;
+        for (const auto &name : store.journal())
+        {
+            fs::path p(name);
+            add_locked(path_stem_generic(p), path_ext_generic(p));
+        }
+        record_ = record;
+    }
+
+    // Folds everything into the store's snapshot.
+    void save()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (store_)
+            store_->compact(entries_);
+    }
+
+    void add(const os_string_t &stem, const os_string_t &ext)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        add_locked(stem, ext);
+    }
+
+    void add(const fs::path &p) { add(path_stem_generic(p), path_ext_generic(p)); }
+
+    // Returns the first free name for stem+ext, in probe order, and marks it used.
+    os_string_t assign(const os_string_t &stem, const os_string_t &ext)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        NameEntry &e = entry(stem, ext);
+        os_string_t name;
+        if (!e.plain_used)
+        {
+            name = stem;
+        }
+        else
+        {
+            while (e.tags.count(e.next_tag))
+                ++e.next_tag;
+            name = stem + from_utf8("[" + pad_num(e.next_tag) + "]");
+        }
+        add_locked(name, ext);
+        return name + ext;
+    }
+
+private:
+    void add_locked(const os_string_t &stem, const os_string_t &ext)
+    {
+        NameEntry &e = entry(stem, ext);
+        if (!e.plain_used && record_)
+            store_->record(stem + ext);
+        e.plain_used = true;
+        if (auto tag = extract_trailing_number_tag(stem))
+        {
+            // Only tags in the exact form the allocator writes can collide with a probe.
+            using char_t = typename os_string_t::value_type;
+            auto pos = stem.find_last_of(static_cast<char_t>('['));
+            os_string_t digits = stem.substr(pos + 1, stem.size() - pos - 2);
+            if (digits == from_utf8(pad_num(*tag)))
+                entry(stem.substr(0, pos), ext).tags.insert(*tag);
+        }
+    }
+
+    NameEntry &entry(const os_string_t &stem, const os_string_t &ext)
+    {
+        using char_t = typename os_string_t::value_type;
+        os_string_t key;
+        key.reserve(stem.size() + 1 + ext.size());
+        key += stem;
+        key += static_cast<char_t>('/');
+        key += ext;
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+            return it->second;
+        NameEntry &e = entries_[key];
+        if (store_)
+            store_->find(key, e);
+        return e;
+    }
+
+    std::unordered_map<os_string_t, NameEntry> entries_;
+    NameStore *store_ = nullptr;
+    bool record_ = false;
+    std::mutex mutex_;
+};
+
+// The copy stage: cfg.jobs workers, at most cfg.per_device at a time on any device.
+class CopyStage
+{
+public:
+    // Called with the new destination when a copy had to take another name than it was given.
+    using OnRename = std::function<void(const fs::path &)>;
+
+    // Once the workers run out of copies, store (if any) is stamped as matching the destination.
+    CopyStage(const Config &cfg, NameIndex &names, NameStore *store, OnRename on_rename = {})
+        : cfg_(cfg), names_(names), store_(store), on_rename_(std::move(on_rename)), copies_(256), limiter_(cfg.per_device), dest_device_(device_key(cfg.dest_dir)),
+          started_(std::chrono::steady_clock::now())
+    {
+        if (cfg_.dry_run)
+            return;
+        for (int i = 0; i < cfg_.jobs; ++i)
+            workers_.emplace_back([this]
+                                  { work(); });
+    }
+
+    ~CopyStage() { finish(); }
+
+    CopyStage(const CopyStage &) = delete;
+    CopyStage &operator=(const CopyStage &) = delete;
+
+    void submit(const fs::path &from, const fs::path &to)
+    {
+        if (cfg_.dry_run)
+            return;
+        std::string dir = reinterpret_cast<const char *>(from.parent_path().u8string().c_str());
+        if (dir != last_dir_)
+        {
+            source_device_ = device_key(from.parent_path());
+            last_dir_ = dir;
+        }
+        ++outstanding_;
+        copies_.push(CopyJob{from, to, source_device_});
+    }
+
+    // Waits for every submitted copy and prints the totals.
+    void finish()
+    {
+        if (finished_)
+            return;
+        finished_ = true;
+        copies_.close();
+        for (auto &w : workers_)
+            w.join();
+
+        if (!cfg_.dry_run && copied_files_ > 0)
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+            std::cout << "Copied " << copied_files_ << " files, " << copied_bytes_ << " bytes in " << std::fixed << std::setprecision(2)
+                      << seconds << " s (" << (seconds > 0 ? copied_bytes_ / seconds / (1024.0 * 1024.0) : 0) << " MB/s)\n"
+                      << std::defaultfloat;
+        }
+    }
+
+private:
+    void work()
+    {
+        while (auto job = copies_.pop())
+        {
+            limiter_.acquire(job->from_device, dest_device_);
+            CopyResult r = copy_file_fast(job->from, job->to);
+            while (r.skipped)
+            {
+                // The destination held a name the index did not (someone else wrote it, or the
+                // store was stale): the next start lists the directory again, and this file
+                // takes the next free name instead of being dropped.
+                if (store_)
+                    store_->invalidate();
+                names_.add(job->to);
+                job->to = cfg_.dest_dir / fs::path(names_.assign(path_stem_generic(job->from), path_ext_generic(job->from)));
+                if (on_rename_)
+                    on_rename_(job->to);
+                {
+                    std::lock_guard<std::mutex> lock(g_print_mutex);
+                    print_path_pair(job->from, job->to);
+                }
+                r = copy_file_fast(job->from, job->to);
+            }
+            limiter_.release(job->from_device, dest_device_);
+            if (r.ec)
+            {
+                std::string u8str(reinterpret_cast<const char *>(job->from.u8string().c_str()));
+                std::lock_guard<std::mutex> lock(g_print_mutex);
+                std::string why = r.ec.message();
+                if (r.shrank)
+                    why += " (source shrank during the copy: " + std::to_string(r.bytes) + " of " + std::to_string(r.expected) + " bytes)";
+                print_error_msg("copy failed for '" + u8str + "': " + why);
+            }
+            else
+            {
+                METRIC_ADD("libpath.bytes_copied", r.bytes);
+                METRIC_INC("libpath.files_copied");
+                copied_bytes_ += r.bytes;
+                ++copied_files_;
+                print_copy_result(job->to, r);
+            }
+            if (--outstanding_ == 0 && store_)
+                store_->stamp();
+        }
+    }
+
+    const Config &cfg_;
+    NameIndex &names_;
+    NameStore *store_;
+    OnRename on_rename_;
+    BoundedQueue<CopyJob> copies_;
+    DeviceLimiter limiter_;
+    const std::string dest_device_;
+    std::atomic<uintmax_t> copied_bytes_{0};
+    std::atomic<int> copied_files_{0};
+    std::atomic<int> outstanding_{0};
+    const std::chrono::steady_clock::time_point started_;
+    std::string last_dir_;
+    std::string source_device_;
+    std::vector<std::thread> workers_;
+    bool finished_ = false;
+};
+
+// The resolve step for one source file: picks its destination name, reports it and queues the copy.
+static fs::path ingest(const Config &cfg, NameIndex &names, CopyStage &copies, const fs::path &p)
+{
+    fs::path candidate;
+    {
+        METRIC_TIMER("libpath.assign_ns");
+        candidate = cfg.dest_dir / fs::path(names.assign(path_stem_generic(p), path_ext_generic(p)));
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_print_mutex);
+        print_path_pair(p, candidate);
+    }
+    copies.submit(p, candidate);
+    return candidate;
+}
+
+// Attaches store to names, which already hold the listing if the store was not valid, and
+// rewrites the store when it is stale or its journal has grown long. A dry run only reads it.
+static void open_store(const Config &cfg, NameIndex &names, NameStore *store)
+{
+    if (!store)
+        return;
+    names.attach(*store, !cfg.dry_run);
+    if (!cfg.dry_run && store->needs_compaction())
+        names.save();
+}
+
+// One round, as three stages connected by bounded queues:
+//   scan    - lists and sorts the source directory (own thread),
+//   resolve - assigns collision-free destination names in sorted order (this thread), so the
+//             [NNNNNN] tags are deterministic no matter how the copies are scheduled,
+//   copy    - see CopyStage.
 int process_iteration(const Config &cfg)
 {
-    auto paths = collect_files(cfg.source_dir);
+    METRIC_TIMER("libpath.iteration_ns");
+    BoundedQueue<fs::path> scanned(1024);
+    std::thread scanner([&]
+                        {
+        METRIC_TIMER("libpath.scan_ns");
+        if (cfg.recursive)
+        {
+            TreeWalker walker(cfg.jobs, walk_skip(cfg.source_dir, cfg.dest_dir), [&](fs::path p)
+                              { scanned.push(std::move(p)); });
+            walker.walk(cfg.source_dir);
+        }
+        else
+        {
+            for (auto &p : collect_sorted_files(cfg.source_dir))
+                scanned.push(std::move(p));
+        }
+        scanned.close(); });
 
-    std::set<fs::path> dest_paths;
+    // The destination listing is read while the scanner works, unless a valid index has it.
+    NameIndex names;
+    std::unique_ptr<NameStore> store;
+    if (cfg.use_index)
+        store = std::make_unique<NameStore>(cfg.dest_dir);
     if (cfg.source_dir == cfg.dest_dir)
     {
-        dest_paths.insert(paths.begin(), paths.end());
+        // Same directory: the source files themselves are taken; they are added below.
     }
-    else
+    else if (!(store && store->valid()) && fs::exists(cfg.dest_dir))
     {
-        if (fs::exists(cfg.dest_dir))
+        METRIC_TIMER("libpath.dest_listing_ns");
+        for (const auto &d : collect_files(cfg.dest_dir))
+            names.add(d);
+    }
+
+    std::vector<fs::path> pending;
+    if (cfg.source_dir == cfg.dest_dir)
+    {
+        // Every source name must be known before the first assignment.
+        while (auto p = scanned.pop())
+            pending.push_back(std::move(*p));
+        if (cfg.recursive)
         {
-            auto dest_files = collect_files(cfg.dest_dir);
-            dest_paths.insert(dest_files.begin(), dest_files.end());
+            // Only the top level of the tree shares the destination's names.
+            for (const auto &d : collect_files(cfg.dest_dir))
+                names.add(d);
+        }
+        else
+        {
+            for (const auto &p : pending)
+                names.add(p);
         }
     }
+    open_store(cfg, names, store.get());
+
+    CopyStage copies(cfg, names, cfg.dry_run ? nullptr : store.get());
 
     int processed_count = 0;
+    size_t next_pending = 0;
+    auto next_path = [&]() -> std::optional<fs::path>
+    {
+        if (cfg.source_dir == cfg.dest_dir)
+            return next_pending < pending.size() ? std::optional<fs::path>(pending[next_pending++]) : std::nullopt;
+        return scanned.pop();
+    };
+    while (auto next = next_path())
+    {
+        ingest(cfg, names, copies, *next);
+        ++processed_count;
+    }
+    scanner.join();
+    copies.finish();
+    return processed_count;
+}
+
+// ------------------------
+// watch mode
+// ------------------------
+struct WatchEvent
+{
+    fs::path path;
+    bool source = true;    // a finished file in the source directory, else a new name in the destination
+    bool overflow = false; // events were dropped; path is empty
+};
+
+// Blocks until something happens in the source or destination directory, so an idle watch
+// costs no CPU. Source files are reported once they are complete, destination files as soon
+// as their name exists.
+#ifdef _WIN32
+class DirWatcher
+{
+public:
+    DirWatcher(const fs::path &source, const fs::path &dest)
+    {
+        add(source, true);
+        if (dest != source)
+            add(dest, false);
+    }
 
-    for (const auto &p : paths)
+    ~DirWatcher()
     {
-        os_string_t stem = path_stem_generic(p);
-        os_string_t ext = path_ext_generic(p);
-        int assigned = -1;
-        fs::path candidate;
-        do
+        for (auto &d : dirs_)
         {
-            os_string_t tag;
-            if (assigned >= 0)
+            DWORD bytes = 0;
+            CancelIo(d->handle);
+            GetOverlappedResult(d->handle, &d->overlapped, &bytes, TRUE);
+            CloseHandle(d->handle);
+            CloseHandle(d->overlapped.hEvent);
+        }
+    }
+
+    DirWatcher(const DirWatcher &) = delete;
+    DirWatcher &operator=(const DirWatcher &) = delete;
+
+    std::vector<WatchEvent> wait()
+    {
+        std::vector<HANDLE> handles;
+        for (auto &d : dirs_)
+            handles.push_back(d->overlapped.hEvent);
+
+        for (;;)
+        {
+            std::vector<WatchEvent> events;
+            // Files still being written are polled until their writer lets go of them.
+            DWORD r = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, pending_.empty() ? INFINITE : 250);
+            if (r == WAIT_FAILED)
+                throw std::system_error(GetLastError(), std::system_category(), "WaitForMultipleObjects");
+            if (r >= WAIT_OBJECT_0 && r < WAIT_OBJECT_0 + handles.size())
             {
-                tag = from_utf8("[" + pad_num(assigned) + "]");
+                Dir &d = *dirs_[r - WAIT_OBJECT_0];
+                DWORD bytes = 0;
+                if (!GetOverlappedResult(d.handle, &d.overlapped, &bytes, FALSE))
+                    throw std::system_error(GetLastError(), std::system_category(), "ReadDirectoryChangesW");
+                if (bytes == 0)
+                    events.push_back(WatchEvent{{}, d.source, true}); // the buffer overflowed
+                for (DWORD off = 0; bytes > 0;)
+                {
+                    auto *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(reinterpret_cast<const char *>(d.buffer.data()) + off);
+                    if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                    {
+                        fs::path p = d.path / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+                        if (!d.source)
+                            events.push_back(WatchEvent{p, false});
+                        else if (std::find(pending_.begin(), pending_.end(), p) == pending_.end())
+                            pending_.push_back(p);
+                    }
+                    if (info->NextEntryOffset == 0)
+                        break;
+                    off += info->NextEntryOffset;
+                }
+                arm(d);
             }
-            candidate = cfg.dest_dir / fs::path(stem + tag + ext);
-            assigned++;
-        } while (dest_paths.count(candidate));
 
-        print_path_pair(p, candidate);
-        if (!cfg.dry_run)
+            for (auto it = pending_.begin(); it != pending_.end();)
+            {
+                // Denying write sharing fails while anyone still has the file open for writing.
+                HANDLE h = CreateFileW(it->c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (h == INVALID_HANDLE_VALUE && GetLastError() == ERROR_SHARING_VIOLATION)
+                {
+                    ++it;
+                    continue;
+                }
+                if (h != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(h);
+                    events.push_back(WatchEvent{*it, true});
+                }
+                it = pending_.erase(it); // gone again, or a directory
+            }
+            if (!events.empty())
+                return events;
+        }
+    }
+
+private:
+    struct Dir
+    {
+        fs::path path;
+        bool source = true;
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped{};
+        std::vector<DWORD> buffer = std::vector<DWORD>(16 * 1024); // DWORD aligned, as required
+    };
+
+    void add(const fs::path &dir, bool source)
+    {
+        auto d = std::make_unique<Dir>();
+        d->path = dir;
+        d->source = source;
+        d->handle = CreateFileW(dir.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (d->handle == INVALID_HANDLE_VALUE)
+            throw std::system_error(GetLastError(), std::system_category(), "CreateFileW");
+        d->overlapped.hEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        arm(*d);
+        dirs_.push_back(std::move(d));
+    }
+
+    void arm(Dir &d)
+    {
+        if (!ReadDirectoryChangesW(d.handle, d.buffer.data(), static_cast<DWORD>(d.buffer.size() * sizeof(DWORD)), FALSE,
+                                   FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &d.overlapped, nullptr))
+            throw std::system_error(GetLastError(), std::system_category(), "ReadDirectoryChangesW");
+    }
+
+    std::vector<std::unique_ptr<Dir>> dirs_;
+    std::vector<fs::path> pending_;
+};
+#else
+class DirWatcher
+{
+public:
+    DirWatcher(const fs::path &source, const fs::path &dest)
+    {
+        fd_ = inotify_init1(IN_CLOEXEC);
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(), "inotify_init1 failed");
+        add(source, IN_CLOSE_WRITE | IN_MOVED_TO, true);
+        if (dest != source)
+            add(dest, IN_CREATE | IN_MOVED_TO, false);
+    }
+
+    ~DirWatcher() { close(fd_); }
+
+    DirWatcher(const DirWatcher &) = delete;
+    DirWatcher &operator=(const DirWatcher &) = delete;
+
+    std::vector<WatchEvent> wait()
+    {
+        alignas(struct inotify_event) char buf[64 * 1024];
+        for (;;)
         {
-            std::error_code ec;
-            fs::copy_file(p, candidate, fs::copy_options::skip_existing, ec);
-            if (ec)
+            ssize_t n = read(fd_, buf, sizeof(buf));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "read from inotify failed");
+            }
+
+            std::vector<WatchEvent> events;
+            for (char *p = buf; p < buf + n;)
             {
-                std::string u8str(reinterpret_cast<const char *>(p.u8string().c_str()));
-                print_error_msg("copy failed for '" + u8str + "': " + ec.message());
+                auto *ev = reinterpret_cast<struct inotify_event *>(p);
+                p += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW)
+                {
+                    events.push_back(WatchEvent{{}, true, true});
+                    continue;
+                }
+                auto dir = dirs_.find(ev->wd);
+                if (dir == dirs_.end() || (ev->mask & IN_ISDIR) || ev->len == 0)
+                    continue;
+                events.push_back(WatchEvent{dir->second.first / ev->name, dir->second.second});
             }
+            if (!events.empty())
+                return events;
         }
+    }
 
-        dest_paths.insert(candidate);
-        ++processed_count;
+private:
+    void add(const fs::path &dir, uint32_t mask, bool source)
+    {
+        int wd = inotify_add_watch(fd_, dir.c_str(), mask | IN_ONLYDIR);
+        if (wd < 0)
+            throw std::system_error(errno, std::generic_category(), "inotify_add_watch failed on " + dir.string());
+        dirs_[wd] = {dir, source};
     }
 
-    return processed_count;
+    int fd_ = -1;
+    std::map<int, std::pair<fs::path, bool>> dirs_; // watch descriptor -> directory, is source
+};
+#endif
+
+// Copies what is in the source directory once, then every file that is completed or moved
+// there afterwards. The name index lives for the whole run and is kept current from the
+// destination's own events, so names stay collision-free without rescanning anything.
+int run_watch(const Config &cfg)
+{
+    const bool same_dir = cfg.source_dir == cfg.dest_dir;
+    // Watch first, so nothing written during the initial scan is missed.
+    DirWatcher watcher(cfg.source_dir, cfg.dest_dir);
+
+    NameIndex names;
+    std::unique_ptr<NameStore> store;
+    if (cfg.use_index)
+        store = std::make_unique<NameStore>(cfg.dest_dir);
+    if (!(store && store->valid()))
+    {
+        for (const auto &d : collect_files(cfg.dest_dir))
+            names.add(d);
+    }
+    open_store(cfg, names, store.get());
+
+    // In place, our own copies show up as new source files; they must not be copied again.
+    // Workers add the names they had to reassign, so the set is shared.
+    std::unordered_set<os_string_t> outputs;
+    std::mutex outputs_mutex;
+    auto output = [&](const fs::path &to)
+    {
+        std::lock_guard<std::mutex> lock(outputs_mutex);
+        outputs.insert(to.filename().native());
+    };
+    auto is_output = [&](const fs::path &p)
+    {
+        std::lock_guard<std::mutex> lock(outputs_mutex);
+        return outputs.count(p.filename().native()) != 0;
+    };
+    CopyStage copies(cfg, names, cfg.dry_run ? nullptr : store.get(), same_dir ? CopyStage::OnRename(output) : CopyStage::OnRename());
+    // Source files ingested so far, so that a rescan after lost events only takes the rest.
+    std::unordered_set<os_string_t> taken;
+    auto take = [&](const fs::path &p)
+    {
+        taken.insert(p.filename().native());
+        fs::path to = ingest(cfg, names, copies, p);
+        if (same_dir)
+            output(to);
+    };
+
+    for (const auto &p : collect_sorted_files(cfg.source_dir))
+        take(p);
+
+    std::cout << "Watching " << reinterpret_cast<const char *>(cfg.source_dir.u8string().c_str()) << " for new files\n"
+              << std::flush;
+    for (;;)
+    {
+        for (const auto &ev : watcher.wait())
+        {
+            METRIC_INC("libpath.watch_events");
+            if (NameStore::owns(ev.path))
+                continue;
+            if (ev.overflow)
+            {
+                // Destination names may have been missed; the index only ever grows, so re-adding is safe.
+                print_error_msg("Watch events were lost; rescanning");
+                for (const auto &d : collect_files(cfg.dest_dir))
+                    names.add(d);
+                if (ev.source)
+                {
+                    // A file still being written is taken as it is now; its completion event
+                    // then copies it again, so nothing is lost, at worst copied twice.
+                    for (const auto &p : collect_sorted_files(cfg.source_dir))
+                    {
+                        if (!taken.count(p.filename().native()) && !is_output(p))
+                            take(p);
+                    }
+                }
+            }
+            else if (!ev.source)
+            {
+                names.add(ev.path);
+            }
+            else if (!is_output(ev.path))
+            {
+                if (same_dir)
+                    names.add(ev.path); // also a name taken in the destination
+                std::error_code ec;
+                if (fs::is_regular_file(ev.path, ec))
+                    take(ev.path);
+            }
+        }
+    }
 }
 
 Config parse_args(int argc, char **argv)
@@ -249,9 +1759,48 @@ Config parse_args(int argc, char **argv)
         {
             cfg.dest_dir = fs::path(argv[++i]);
         }
+        else if ((a == "-j" || a == "--jobs") && i + 1 < argc)
+        {
+            cfg.jobs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (a == "--per-device" && i + 1 < argc)
+        {
+            cfg.per_device = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (a == "--iterations" && i + 1 < argc)
+        {
+            cfg.iterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (a == "--interval" && i + 1 < argc)
+        {
+            cfg.sleep_seconds = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (a == "--watch")
+        {
+            cfg.watch = true;
+        }
+        else if (a == "--index")
+        {
+            cfg.use_index = true;
+        }
+        else if (a == "-r" || a == "--recursive")
+        {
+            cfg.recursive = true;
+        }
+        else if (a == "--metrics" && i + 1 < argc)
+        {
+            cfg.metrics = argv[++i];
+        }
+        else if (a == "--metrics-interval" && i + 1 < argc)
+        {
+            cfg.metrics_interval = std::max(0, std::atoi(argv[++i]));
+        }
         else if (a == "-h" || a == "--help")
         {
-            std::cout << "Usage: " << (argv[0] ? argv[0] : "libpath") << " [--source <dir>] [--dest <dir>] [--dry-run]\n";
+            std::cout << "Usage: " << (argv[0] ? argv[0] : "libpath")
+                      << " [--source <dir>] [--dest <dir>] [--dry-run] [--jobs <n>] [--per-device <n>]"
+                         " [--iterations <n>] [--interval <seconds>] [--watch] [--index] [--recursive]"
+                         " [--metrics step|json] [--metrics-interval <seconds>]\n";
             std::exit(0);
         }
     }
@@ -261,6 +1810,8 @@ Config parse_args(int argc, char **argv)
 // ------------------------
 // main: process_iteration을 반복 호출하여 외부 루프 유지
 // ------------------------
+// bench/libpath_bench.cpp includes this file with LIBPATH_NO_MAIN to reach the internals.
+#ifndef LIBPATH_NO_MAIN
 int main(int argc, char **argv)
 {
 #ifdef _WIN32
@@ -290,8 +1841,38 @@ int main(int argc, char **argv)
         }
     }
 
-    static constexpr int MAX_ITERATIONS = 10; // 안전 장치
-    static constexpr int SLEEP_SECONDS = 5;   // 반복 간 대기 시간
+    std::optional<metrics::Reporter> reporter;
+    if (!cfg.metrics.empty())
+    {
+        auto format = metrics::parse_format(cfg.metrics);
+        if (!format)
+        {
+            print_error_msg("--metrics takes step or json");
+            return 1;
+        }
+        reporter.emplace(*format, std::chrono::seconds(cfg.metrics_interval));
+    }
+
+    if (cfg.watch && cfg.recursive)
+    {
+        print_error_msg("--watch only watches the top level; it cannot be combined with --recursive");
+        return 1;
+    }
+    if (cfg.watch)
+    {
+        try
+        {
+            return run_watch(cfg);
+        }
+        catch (const std::system_error &e)
+        {
+            print_error_msg(std::string("Watch failed: ") + e.what());
+            return 1;
+        }
+    }
+
+    const int MAX_ITERATIONS = cfg.iterations;  // 안전 장치
+    const int SLEEP_SECONDS = cfg.sleep_seconds; // 반복 간 대기 시간
 
     for (int iter = 0; iter < MAX_ITERATIONS; ++iter)
     {
@@ -317,4 +1898,5 @@ int main(int argc, char **argv)
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#endif // LIBPATH_NO_MAIN
@@ -0,0 +1,372 @@
+#include "argparser.hpp"
+#include "logger.hpp"
+#include <cstdio>
+#include <vector>
+
+// Renders a binary log written by Logger::set_binary_logfile() back into the text format
+// used by the text sinks.
+
+using namespace argparse;
+using log_binary::ArgTag;
+using log_binary::RecordKind;
+
+struct Site
+{
+    LogLevel level = LogLevel::LOG_INFO;
+    bool printf_style = false;
+    int line = 0;
+    std::string file;
+    std::string fmt;
+};
+
+struct Arg
+{
+    ArgTag tag = ArgTag::Int;
+    int64_t i = 0;
+    uint64_t u = 0;
+    double d = 0;
+    float f = 0;
+    char c = 0;
+    bool b = false;
+    std::string_view s;
+};
+
+class Reader
+{
+public:
+    explicit Reader(std::FILE *fp) : fp_(fp) {}
+
+    template <typename T>
+    bool get(T &value)
+    {
+        return std::fread(&value, sizeof(value), 1, fp_) == 1;
+    }
+
+    bool get_bytes(std::string &out, size_t n)
+    {
+        out.resize(n);
+        return n == 0 || std::fread(out.data(), 1, n, fp_) == n;
+    }
+
+private:
+    std::FILE *fp_;
+};
+
+template <typename T>
+static bool take(std::string_view &in, T &value)
+{
+    if (in.size() < sizeof(T))
+        return false;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+static bool decode_args(std::string_view in, std::vector<Arg> &args)
+{
+    args.clear();
+    while (!in.empty())
+    {
+        Arg a;
+        if (!take(in, a.tag))
+            return false;
+        bool ok = true;
+        switch (a.tag)
+        {
+        case ArgTag::Int:
+            ok = take(in, a.i);
+            break;
+        case ArgTag::UInt:
+        case ArgTag::Pointer:
+            ok = take(in, a.u);
+            break;
+        case ArgTag::Double:
+            ok = take(in, a.d);
+            break;
+        case ArgTag::Float:
+            ok = take(in, a.f);
+            break;
+        case ArgTag::Char:
+            ok = take(in, a.c);
+            break;
+        case ArgTag::Bool:
+        {
+            uint8_t v = 0;
+            ok = take(in, v);
+            a.b = v != 0;
+            break;
+        }
+        case ArgTag::String:
+        case ArgTag::Formatted:
+        {
+            uint32_t len = 0;
+            ok = take(in, len) && in.size() >= len;
+            if (ok)
+            {
+                a.s = in.substr(0, len);
+                in.remove_prefix(len);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        if (!ok)
+            return false;
+        args.push_back(a);
+    }
+    return true;
+}
+
+// Calls fn with the argument as the C++ type it was logged with.
+template <typename Fn>
+static void visit_arg(const Arg &a, Fn &&fn)
+{
+    switch (a.tag)
+    {
+    case ArgTag::Int:
+        return fn(static_cast<long long>(a.i));
+    case ArgTag::UInt:
+        return fn(static_cast<unsigned long long>(a.u));
+    case ArgTag::Double:
+        return fn(a.d);
+    case ArgTag::Float:
+        return fn(a.f);
+    case ArgTag::Char:
+        return fn(a.c);
+    case ArgTag::Bool:
+        return fn(a.b);
+    case ArgTag::String:
+    case ArgTag::Formatted:
+        return fn(a.s);
+    case ArgTag::Pointer:
+        return fn(reinterpret_cast<const void *>(static_cast<uintptr_t>(a.u)));
+    }
+}
+
+static void format_printf_args(std::string &out, std::string_view fmt, const std::vector<Arg> &args)
+{
+    size_t pos = 0;
+    for (const auto &a : args)
+    {
+        std::string_view spec = Logger::next_printf_spec(out, fmt, pos);
+        visit_arg(a, [&](auto v)
+                  { Logger::format_one_arg(out, v, spec); });
+    }
+    Logger::next_printf_spec(out, fmt, pos);
+}
+
+// Replays a std::format string one replacement field at a time. Dynamic width/precision
+// ("{:{}}") is replaced by the value of the integer argument it names before formatting.
+static void format_brace_args(std::string &out, std::string_view fmt, const std::vector<Arg> &args)
+{
+    size_t next_arg = 0;
+    std::string field_fmt;
+    for (size_t i = 0; i < fmt.size(); ++i)
+    {
+        char ch = fmt[i];
+        if (ch == '}' && i + 1 < fmt.size() && fmt[i + 1] == '}')
+        {
+            out += '}';
+            ++i;
+            continue;
+        }
+        if (ch != '{')
+        {
+            out += ch;
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '{')
+        {
+            out += '{';
+            ++i;
+            continue;
+        }
+
+        // The field ends at the first '}' outside its nested fields.
+        size_t close = fmt.find_first_of("{}", i + 1);
+        while (close != std::string_view::npos && fmt[close] == '{')
+        {
+            close = fmt.find('}', close);
+            if (close != std::string_view::npos)
+                close = fmt.find_first_of("{}", close + 1);
+        }
+        if (close == std::string_view::npos)
+        {
+            out += fmt.substr(i);
+            break;
+        }
+        std::string_view field = fmt.substr(i + 1, close - i - 1);
+        std::string_view index = field.substr(0, field.find(':'));
+        std::string_view spec = index.size() < field.size() ? field.substr(index.size()) : std::string_view{};
+        i = close;
+
+        size_t arg_index = next_arg++;
+        if (!index.empty())
+            std::from_chars(index.data(), index.data() + index.size(), arg_index);
+
+        // Nested fields are numbered after their field, so resolve them even if it is skipped.
+        field_fmt = "{";
+        bool nested_ok = true;
+        for (size_t k = 0; k < spec.size(); ++k)
+        {
+            if (spec[k] != '{')
+            {
+                field_fmt += spec[k];
+                continue;
+            }
+            size_t end = spec.find('}', k);
+            std::string_view id = spec.substr(k + 1, end - k - 1);
+            size_t n = next_arg++;
+            if (!id.empty())
+                std::from_chars(id.data(), id.data() + id.size(), n);
+            if (n < args.size() && args[n].tag == ArgTag::Int)
+                field_fmt += std::to_string(args[n].i);
+            else if (n < args.size() && args[n].tag == ArgTag::UInt)
+                field_fmt += std::to_string(args[n].u);
+            else
+                nested_ok = false;
+            k = end;
+        }
+        field_fmt += "}";
+
+        if (arg_index >= args.size())
+        {
+            out += "[missing arg]";
+            continue;
+        }
+        if (args[arg_index].tag == ArgTag::Formatted)
+        {
+            out += args[arg_index].s; // the spec was applied when the record was written
+            continue;
+        }
+        if (!nested_ok)
+        {
+            out += "[FORMAT_ERROR: {" + std::string(field) + "}]";
+            continue;
+        }
+        try
+        {
+            visit_arg(args[arg_index], [&](auto v)
+                      { std::vformat_to(std::back_inserter(out), field_fmt, std::make_format_args(v)); });
+        }
+        catch (const std::exception &)
+        {
+            out += "[FORMAT_ERROR: " + field_fmt + "]";
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ArgParser parser("Decode a binary Logger file into text. ver. 0.1.0");
+    parser.add_positional("input", "Binary log file.", true);
+    parser.add_option("--output", "-o", "write text to this file instead of stdout");
+    if (!parser.parse(argc, argv))
+    {
+        return 1;
+    }
+
+    auto input = parser.get_positional("input").value();
+    std::FILE *in = std::fopen(input.c_str(), "rb");
+    if (!in)
+    {
+        std::fprintf(stderr, "Failed to open %s\n", input.c_str());
+        return 1;
+    }
+    std::FILE *out = stdout;
+    if (auto output = parser.get("output"))
+    {
+        out = std::fopen(output->c_str(), "w");
+        if (!out)
+        {
+            std::fprintf(stderr, "Failed to create %s\n", output->c_str());
+            std::fclose(in);
+            return 1;
+        }
+    }
+
+    Reader reader(in);
+    std::vector<Site> sites;
+    std::vector<Arg> args;
+    std::string payload, msg, line;
+    size_t records = 0;
+    bool corrupt = false;
+
+    char magic[sizeof(log_binary::magic)];
+    if (!reader.get(magic) || std::memcmp(magic, log_binary::magic, sizeof(magic)) != 0)
+    {
+        std::fprintf(stderr, "%s is not a binary log file\n", input.c_str());
+        corrupt = true;
+    }
+
+    uint8_t kind_byte;
+    while (!corrupt && reader.get(kind_byte))
+    {
+        if (kind_byte == static_cast<uint8_t>(log_binary::magic[0]))
+        {
+            // Next session appended to the same file: site ids start over.
+            if (!reader.get_bytes(payload, sizeof(magic) - 1) || payload != std::string_view(log_binary::magic + 1, sizeof(magic) - 1))
+                corrupt = true;
+            sites.clear();
+            continue;
+        }
+
+        uint32_t id = 0;
+        if (kind_byte == static_cast<uint8_t>(RecordKind::Site))
+        {
+            uint8_t level, printf_style;
+            uint32_t site_line, fmt_len;
+            uint16_t file_len;
+            Site site;
+            if (!reader.get(id) || !reader.get(level) || !reader.get(printf_style) || !reader.get(site_line) ||
+                !reader.get(file_len) || !reader.get_bytes(site.file, file_len) ||
+                !reader.get(fmt_len) || !reader.get_bytes(site.fmt, fmt_len))
+            {
+                corrupt = true;
+                break;
+            }
+            site.level = static_cast<LogLevel>(level);
+            site.printf_style = printf_style != 0;
+            site.line = static_cast<int>(site_line);
+            if (id >= sites.size())
+                sites.resize(id + 1);
+            sites[id] = std::move(site);
+        }
+        else if (kind_byte == static_cast<uint8_t>(RecordKind::Message))
+        {
+            int64_t time_ns;
+            uint32_t args_len;
+            if (!reader.get(id) || !reader.get(time_ns) || !reader.get(args_len) || !reader.get_bytes(payload, args_len) ||
+                id >= sites.size() || !decode_args(payload, args))
+            {
+                corrupt = true;
+                break;
+            }
+            const Site &site = sites[id];
+            msg.clear();
+            if (site.printf_style)
+                format_printf_args(msg, site.fmt, args);
+            else
+                format_brace_args(msg, site.fmt, args);
+
+            auto time = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(time_ns)));
+            line.clear();
+            Logger::render_record(line, site.level, time, site.file, site.line, msg);
+            std::fwrite(line.data(), 1, line.size(), out);
+            ++records;
+        }
+        else
+        {
+            corrupt = true;
+        }
+    }
+
+    if (corrupt)
+        std::fprintf(stderr, "Stopped at a truncated or corrupt record after %zu record(s)\n", records);
+    std::fclose(in);
+    if (out != stdout)
+        std::fclose(out);
+    return corrupt ? 1 : 0;
+}
@@ -11,13 +11,31 @@
 #include <unordered_map>
 #include <format>
 #include <filesystem>
-#include <tuple>
 #include <utility>
 #include <type_traits>
 #include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 
 #define LIBUTILS_HAS_FMT 0
 
+// Log call sites below this level are compiled out entirely (arguments are never evaluated).
+// Values follow LogLevel: 0 = TRACE, 1 = DEBUG, 2 = STEP, 3 = INFO, 4 = WARNING, 5 = ERROR, 6 = FATAL.
+// Release builds (NDEBUG) drop TRACE and DEBUG unless overridden with -DLIBUTILS_LOG_MIN_LEVEL=<n>.
+#ifndef LIBUTILS_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LIBUTILS_LOG_MIN_LEVEL 2
+#else
+#define LIBUTILS_LOG_MIN_LEVEL 0
+#endif
+#endif
+
 enum class LogLevel
 {
     LOG_TRACE,
@@ -29,6 +47,534 @@ enum class LogLevel
     LOG_FATAL
 };
 
+// What a producer does when the async queue is full.
+enum class LogOverflowPolicy
+{
+    Block,       // spin/yield until the writer thread frees a slot
+    DropNewest,  // discard the record that did not fit
+    DropAndCount // discard it and report the number of dropped records later
+};
+
+namespace log_detail
+{
+    inline constexpr std::string_view printf_conversions = "diuoxXfFeEgGaAcspn";
+
+    // Position of the conversion letter of the printf conversion that starts at s[percent], or npos
+    // if that '%' does not start one. Flags, width, precision and length modifiers are skipped.
+    constexpr size_t printf_conversion_end(std::string_view s, size_t percent)
+    {
+        size_t end = s.find_first_not_of("-+ #0123456789.*hljztLq", percent + 1);
+        if (end == std::string_view::npos || printf_conversions.find(s[end]) == std::string_view::npos)
+            return std::string_view::npos;
+        return end;
+    }
+
+    constexpr bool is_printf_style(std::string_view s)
+    {
+        for (size_t i = 0; i + 1 < s.size(); ++i)
+        {
+            if (s[i] == '%')
+            {
+                if (s[i + 1] == '%')
+                {
+                    ++i;
+                    continue;
+                }
+                if (printf_conversion_end(s, i) != std::string_view::npos)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Calls fn(arg_index, spec) for every replacement field of a std::format string that
+    // std::format_string has already accepted, including nested width/precision fields.
+    // spec keeps its leading ':' and is empty for "{}" and for nested fields.
+    template <typename Fn>
+    constexpr void for_each_format_field(std::string_view s, Fn &&fn)
+    {
+        size_t next_index = 0;
+        auto arg_index = [&next_index](std::string_view id)
+        {
+            if (id.empty())
+                return next_index++;
+            size_t index = 0;
+            for (char c : id)
+                index = index * 10 + static_cast<size_t>(c - '0');
+            return index;
+        };
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '}')
+            {
+                ++i; // "}}"
+                continue;
+            }
+            if (s[i] != '{')
+                continue;
+            if (s[i + 1] == '{')
+            {
+                ++i;
+                continue;
+            }
+            size_t end = s.find_first_of(":}", i + 1);
+            const size_t index = arg_index(s.substr(i + 1, end - i - 1));
+            if (s[end] == '}')
+            {
+                fn(index, std::string_view{});
+                i = end;
+                continue;
+            }
+            // The field's own index comes before those of its nested fields; fill may not be a brace.
+            const size_t spec_start = end;
+            size_t nested_count = 0;
+            size_t nested[2] = {};
+            for (++end; s[end] != '}'; ++end)
+            {
+                if (s[end] == '{')
+                {
+                    size_t close = s.find('}', end);
+                    if (nested_count < 2)
+                        nested[nested_count++] = arg_index(s.substr(end + 1, close - end - 1));
+                    end = close;
+                }
+            }
+            fn(index, s.substr(spec_start, end - spec_start));
+            for (size_t n = 0; n < nested_count; ++n)
+                fn(nested[n], std::string_view{});
+            i = end;
+        }
+    }
+
+    enum class ArgKind
+    {
+        Integral,
+        Floating,
+        CString, // const char * or char array
+        String,  // std::string / std::string_view
+        Pointer,
+        Other
+    };
+
+    template <typename T>
+    consteval ArgKind arg_kind()
+    {
+        using D = std::decay_t<T>;
+        if constexpr (std::is_convertible_v<D, const char *>)
+            return ArgKind::CString;
+        else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>)
+            return ArgKind::String;
+        else if constexpr (std::is_integral_v<D>)
+            return ArgKind::Integral;
+        else if constexpr (std::is_floating_point_v<D>)
+            return ArgKind::Floating;
+        else if constexpr (std::is_pointer_v<D>)
+            return ArgKind::Pointer;
+        else
+            return ArgKind::Other;
+    }
+
+    // Not constexpr on purpose: reaching one of these during constant evaluation turns a bad
+    // format string into a compile error whose message names the problem.
+    inline void printf_format_has_more_conversions_than_arguments() {}
+    inline void printf_format_has_fewer_conversions_than_arguments() {}
+    inline void printf_argument_type_does_not_match_conversion() {}
+    inline void printf_conversion_n_is_not_supported() {}
+    inline void printf_star_width_or_precision_is_not_supported() {}
+    inline void format_has_arguments_without_replacement_field() {}
+
+    // std::format_string accepts arguments no field refers to; they would be dropped silently.
+    template <typename... Args>
+    consteval void check_brace_format(std::string_view fmt)
+    {
+        constexpr size_t count = sizeof...(Args) < 64 ? sizeof...(Args) : 64;
+        uint64_t used = 0;
+        for_each_format_field(fmt, [&used](size_t index, std::string_view)
+                              {
+            if (index < 64)
+                used |= uint64_t{1} << index; });
+        for (size_t i = 0; i < count; ++i)
+            if (!(used & (uint64_t{1} << i)))
+                format_has_arguments_without_replacement_field();
+    }
+
+    // Returns a mask with bit i set when argument i is printed with %p (the first 64 arguments).
+    template <typename... Args>
+    consteval uint64_t check_printf_format(std::string_view fmt)
+    {
+        constexpr ArgKind kinds[] = {arg_kind<Args>()..., ArgKind::Other};
+        uint64_t pointer_args = 0;
+        size_t arg_index = 0;
+        size_t i = 0;
+        while (i < fmt.size())
+        {
+            size_t percent_pos = fmt.find('%', i);
+            if (percent_pos == std::string_view::npos || percent_pos + 1 >= fmt.size())
+                break;
+            if (fmt[percent_pos + 1] == '%')
+            {
+                i = percent_pos + 2;
+                continue;
+            }
+            size_t spec_end = printf_conversion_end(fmt, percent_pos);
+            if (spec_end == std::string_view::npos)
+            {
+                i = percent_pos + 1;
+                continue;
+            }
+            if (fmt.substr(percent_pos, spec_end - percent_pos).find('*') != std::string_view::npos)
+                printf_star_width_or_precision_is_not_supported();
+            if (arg_index >= sizeof...(Args))
+                printf_format_has_more_conversions_than_arguments();
+
+            const ArgKind kind = kinds[arg_index];
+            switch (fmt[spec_end])
+            {
+            case 's':
+                if (kind != ArgKind::String && kind != ArgKind::CString)
+                    printf_argument_type_does_not_match_conversion();
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (kind != ArgKind::Floating)
+                    printf_argument_type_does_not_match_conversion();
+                break;
+            case 'p':
+                if (kind != ArgKind::Pointer && kind != ArgKind::CString)
+                    printf_argument_type_does_not_match_conversion();
+                if (arg_index < 64)
+                    pointer_args |= uint64_t{1} << arg_index;
+                break;
+            case 'n':
+                printf_conversion_n_is_not_supported();
+                break;
+            default: // d i u o x X c
+                if (kind != ArgKind::Integral)
+                    printf_argument_type_does_not_match_conversion();
+                break;
+            }
+            ++arg_index;
+            i = spec_end + 1;
+        }
+        if (arg_index != sizeof...(Args))
+            printf_format_has_fewer_conversions_than_arguments();
+        return pointer_args;
+    }
+
+
+    // Strips the directory part of __FILE__ during compilation.
+    consteval std::string_view source_basename(std::string_view path)
+    {
+        size_t pos = path.find_last_of("/\\");
+        return pos == std::string_view::npos ? path : path.substr(pos + 1);
+    }
+}
+
+// Format string checked at compile time against the argument types. Strings containing a printf
+// conversion ("%d", "%-8s", "%.2f", ...) are validated as printf-style, everything else as
+// std::format, where every argument must also be referenced by a replacement field.
+template <typename... Args>
+struct BasicLogFormat
+{
+    std::string_view str;
+    bool printf_style;
+    uint64_t pointer_args = 0; // printf-style: bit i is set when argument i is printed with %p
+
+    template <typename S>
+        requires std::is_convertible_v<const S &, std::string_view>
+    consteval BasicLogFormat(const S &s) : str(s), printf_style(log_detail::is_printf_style(str))
+    {
+        if (printf_style)
+            pointer_args = log_detail::check_printf_format<Args...>(str);
+        else
+        {
+            [[maybe_unused]] std::format_string<Args...> checked(s);
+            log_detail::check_brace_format<Args...>(str);
+        }
+    }
+};
+
+template <typename... Args>
+using LogFormat = BasicLogFormat<std::type_identity_t<Args>...>;
+
+// Static data of one LOG_* call site. The id is assigned the first time the site is written to
+// a binary log; the file name and format string are then stored once instead of per record.
+struct LogSite
+{
+    std::string_view file; // basename of __FILE__
+    int line = 0;
+    std::atomic<uint32_t> id{0};
+};
+
+// Binary log file layout, in host byte order. Every open of the file appends a new session that
+// starts with the magic; site ids are only meaningful within their session.
+//   session := magic record*
+//   Site    := u8 kind=1, u32 id, u8 level, u8 printf_style, u32 line, u16 file_len, file, u32 fmt_len, fmt
+//   Message := u8 kind=2, u32 id, i64 time_ns (system_clock epoch), u32 args_len, arg*
+//   arg     := u8 ArgTag, then i64/u64/double/u64 (Int/UInt/Double/Pointer), float (Float),
+//              u8 (Char/Bool) or u32 len + bytes (String/Formatted)
+namespace log_binary
+{
+    inline constexpr char magic[8] = {'L', 'U', 'B', 'L', 'O', 'G', '1', '\0'};
+
+    enum class RecordKind : uint8_t
+    {
+        Site = 1,
+        Message = 2
+    };
+
+    enum class ArgTag : uint8_t
+    {
+        Int = 1,
+        UInt,
+        Double,
+        Float,
+        Char,
+        Bool,
+        String,
+        Pointer,
+        Formatted // text already rendered with its replacement field's spec; printed as is
+    };
+
+    template <typename T>
+    void put(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    inline void put_string(std::string &out, std::string_view s)
+    {
+        put(out, ArgTag::String);
+        put(out, static_cast<uint32_t>(s.size()));
+        out += s;
+    }
+
+    // Spec of the first replacement field that prints argument index, with nested width/precision
+    // fields replaced by the values of the arguments they name, so that it formats that argument
+    // on its own. Empty if no field prints it.
+    template <typename... Args>
+    std::string field_spec(std::string_view fmt, size_t index, const Args &...args)
+    {
+        std::string_view spec;
+        size_t nested[2] = {};
+        size_t wanted = 0, seen = 0;
+        bool found = false;
+        log_detail::for_each_format_field(fmt, [&](size_t i, std::string_view field)
+                                          {
+            if (found)
+            {
+                if (seen < wanted)
+                    nested[seen++] = i; // nested fields are reported right after their field
+                return;
+            }
+            if (i == index)
+            {
+                found = true;
+                spec = field;
+                wanted = std::min<size_t>(std::count(field.begin(), field.end(), '{'), 2);
+            } });
+
+        std::string out;
+        size_t next = 0;
+        for (size_t k = 0; k < spec.size(); ++k)
+        {
+            if (spec[k] != '{')
+            {
+                out += spec[k];
+                continue;
+            }
+            const size_t n = next < seen ? nested[next++] : sizeof...(Args);
+            long long value = 0;
+            size_t arg = 0;
+            ([&](const auto &a)
+             {
+                if constexpr (std::is_integral_v<std::decay_t<decltype(a)>>)
+                    if (arg == n)
+                        value = static_cast<long long>(a);
+                ++arg; }(args),
+             ...);
+            out += std::to_string(value);
+            k = spec.find('}', k);
+        }
+        return out;
+    }
+
+    // Raw argument bytes. A C string printed with %p (as_pointer) is stored as its address.
+    // Types without a binary form are formatted up front with spec, the ":..." of their
+    // replacement field (see field_spec), since the decoder cannot apply it to them.
+    template <typename T>
+    void encode_arg(std::string &out, const T &v, bool as_pointer = false, std::string_view spec = {})
+    {
+        using D = std::decay_t<T>;
+        if constexpr (std::is_same_v<D, bool>)
+        {
+            put(out, ArgTag::Bool);
+            put(out, static_cast<uint8_t>(v));
+        }
+        else if constexpr (std::is_same_v<D, char>)
+        {
+            put(out, ArgTag::Char);
+            put(out, v);
+        }
+        else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+        {
+            put(out, ArgTag::Int);
+            put(out, static_cast<int64_t>(v));
+        }
+        else if constexpr (std::is_integral_v<D>)
+        {
+            put(out, ArgTag::UInt);
+            put(out, static_cast<uint64_t>(v));
+        }
+        else if constexpr (std::is_same_v<D, float>)
+        {
+            put(out, ArgTag::Float);
+            put(out, v);
+        }
+        else if constexpr (std::is_floating_point_v<D>)
+        {
+            put(out, ArgTag::Double);
+            put(out, static_cast<double>(v));
+        }
+        else if constexpr (std::is_convertible_v<D, const char *>)
+        {
+            const char *str = static_cast<const char *>(v);
+            if (as_pointer)
+            {
+                put(out, ArgTag::Pointer);
+                put(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(str)));
+            }
+            else
+                put_string(out, str ? std::string_view(str) : std::string_view("(null)"));
+        }
+        else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>)
+        {
+            put_string(out, v);
+        }
+        else if constexpr (std::is_pointer_v<D>)
+        {
+            put(out, ArgTag::Pointer);
+            put(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+        }
+        else
+        {
+            std::string text;
+            try
+            {
+                text = std::vformat("{" + std::string(spec) + "}", std::make_format_args(v));
+            }
+            catch (const std::exception &)
+            {
+                text = std::format("{}", v); // e.g. a negative dynamic width
+            }
+            put(out, ArgTag::Formatted);
+            put(out, static_cast<uint32_t>(text.size()));
+            out += text;
+        }
+    }
+}
+
+// A fully formatted log record, ready to be written to the sinks.
+struct LogRecord
+{
+    LogLevel level = LogLevel::LOG_INFO;
+    std::chrono::system_clock::time_point time;
+    std::string_view file; // basename of __FILE__, which has static storage
+    int line = 0;
+    std::string msg;
+};
+
+// Bounded multi-producer / single-consumer ring buffer (Vyukov-style sequence slots).
+// Producers never take a lock; the single consumer is the logger's writer thread.
+class LogRingBuffer
+{
+public:
+    explicit LogRingBuffer(size_t capacity)
+    {
+        size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+        mask_ = cap - 1;
+        slots_ = std::make_unique<Slot[]>(cap);
+        for (size_t i = 0; i < cap; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // fill(LogRecord &) writes the record in place, so the slot's string capacity is reused.
+    template <typename Fill>
+    bool try_push(Fill &&fill)
+    {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot &slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (dif == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    fill(slot.rec);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side: returns the next published record or nullptr. Call release() when done with it.
+    LogRecord *front()
+    {
+        Slot &slot = slots_[dequeue_pos_ & mask_];
+        if (slot.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1)
+            return nullptr;
+        return &slot.rec;
+    }
+
+    void release()
+    {
+        Slot &slot = slots_[dequeue_pos_ & mask_];
+        slot.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+    }
+
+    bool empty()
+    {
+        return front() == nullptr;
+    }
+
+    // Number of records claimed by producers so far (monotonic).
+    size_t enqueued() const { return enqueue_pos_.load(std::memory_order_acquire); }
+    // Number of records consumed so far. Only valid on the consumer thread.
+    size_t dequeued() const { return dequeue_pos_; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq{0};
+        LogRecord rec;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0;
+};
+
 class Logger
 {
 public:
@@ -43,7 +589,13 @@ public:
 
     void set_level(LogLevel level)
     {
-        level_ = level;
+        level_.store(level, std::memory_order_relaxed);
+    }
+
+    // Cheap check used by the LOG_* macros before any argument is evaluated.
+    bool enabled(LogLevel msg_level) const
+    {
+        return msg_level >= level_.load(std::memory_order_relaxed);
     }
 
     void set_level(const std::string &level_str)
@@ -60,14 +612,7 @@ public:
         std::string upper_level = level_str;
         std::transform(upper_level.begin(), upper_level.end(), upper_level.begin(), ::toupper);
         auto it = level_map.find(upper_level);
-        if (it != level_map.end())
-        {
-            level_ = it->second;
-        }
-        else
-        {
-            level_ = LogLevel::LOG_INFO;
-        }
+        set_level(it != level_map.end() ? it->second : LogLevel::LOG_INFO);
     }
 
     void set_logfile(const std::string &path)
@@ -84,184 +629,408 @@ public:
         }
     }
 
+    // Write records as compact binary (see log_binary) instead of text; decode them with
+    // logdecode. WARNING and above still go to the text sinks so problems stay visible.
+    // Each thread collects its records in its own buffer and writes them out in blocks, so
+    // records of different threads are grouped by thread in the file; each carries its time.
+    // An empty path closes the binary log.
+    void set_binary_logfile(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(binary_mutex_);
+        binary_enabled_.store(false, std::memory_order_relaxed);
+        if (binary_stream_)
+        {
+            for (auto &buffer : binary_buffers_)
+                drain(*buffer);
+        }
+        binary_stream_.reset();
+        binary_session_.fetch_add(1, std::memory_order_relaxed);
+        if (path.empty())
+            return;
+
+        binary_buf_.resize(1 << 20);
+        auto stream = std::make_unique<std::ofstream>();
+        stream->rdbuf()->pubsetbuf(binary_buf_.data(), static_cast<std::streamsize>(binary_buf_.size()));
+        stream->open(path, std::ios::binary | std::ios::app);
+        if (!stream->is_open())
+        {
+            std::cerr << "Failed to open binary log file: " << path << std::endl;
+            return;
+        }
+        stream->write(log_binary::magic, sizeof(log_binary::magic));
+        binary_stream_ = std::move(stream);
+        binary_enabled_.store(true, std::memory_order_relaxed);
+    }
+
     template <typename... Args>
-    void log_impl(LogLevel msg_level, std::string_view file, int line, const std::string &fmt_str, Args &&...args)
+    void log_impl(LogLevel msg_level, LogSite &site, LogFormat<Args...> fmt, Args &&...args)
     {
-        if (msg_level < level_)
+        if (!enabled(msg_level))
             return;
+        log_unfiltered(msg_level, site, fmt, std::forward<Args>(args)...);
+    }
 
+    // Writes a record whatever the current level, for output that was asked for explicitly
+    // (such as --metrics) and must not depend on, or change, the level set for everything else.
+    template <typename... Args>
+    void log_unfiltered(LogLevel msg_level, LogSite &site, LogFormat<Args...> fmt, Args &&...args)
+    {
         auto now = std::chrono::system_clock::now();
 
-        std::string msg;
+        if (binary_enabled_.load(std::memory_order_relaxed))
+        {
+            write_binary(msg_level, site, fmt.str, fmt.printf_style, fmt.pointer_args, now, args...);
+            if (msg_level < LogLevel::LOG_WARNING)
+                return;
+        }
+
+        const std::string_view file = site.file;
+        const int line = site.line;
+
+        // Per-thread buffers keep their capacity, so steady-state logging does not allocate.
+        thread_local std::string msg_buf;
+        msg_buf.clear();
         try
         {
-            if (is_printf_style(fmt_str))
-            {
-                auto tup = std::forward_as_tuple(std::forward<Args>(args)...);
-                msg = format_printf(fmt_str, tup);
-            }
+            if (fmt.printf_style)
+                format_printf(msg_buf, fmt.str, args...);
             else
-            {
-
-                msg = std::vformat(fmt_str, std::make_format_args(args...));
-            }
+                std::vformat_to(std::back_inserter(msg_buf), fmt.str, std::make_format_args(args...));
         }
         catch (const std::exception &e)
         {
-            msg = std::string("Log formatting error: ") + e.what();
-            std::cerr << msg << std::endl;
-            msg = fmt_str;
+            std::cerr << "Log formatting error: " << e.what() << std::endl;
+            msg_buf = fmt.str;
         }
 
+        if (queue_)
+        {
+            enqueue(msg_level, now, file, line, msg_buf);
+            return;
+        }
+
+        thread_local std::string line_buf;
+        line_buf.clear();
+        render_record(line_buf, msg_level, now, file, line, msg_buf);
+
         std::lock_guard<std::mutex> lock(mutex_);
 
-        // Format and print header to both streams
-        auto print_header = [&](std::ostream &os)
+        std::cout.write(line_buf.data(), static_cast<std::streamsize>(line_buf.size())).flush();
+
+        if (file_stream_ && file_stream_->is_open())
         {
-            // C++20 formatting for timestamp with milliseconds
-            const auto time_in_ms = std::chrono::time_point_cast<std::chrono::milliseconds>(now);
-            const auto zoned_time = std::chrono::zoned_time(std::chrono::current_zone(), time_in_ms);
+            file_stream_->write(line_buf.data(), static_cast<std::streamsize>(line_buf.size())).flush();
+        }
+    }
 
-            os << std::format("{:%Y-%m-%d_%H:%M:%S}", zoned_time)
-               << "-[" << level_to_string(msg_level) << "] ";
-            if (line > 0)
+    // Switch to asynchronous logging: log calls only format the message and push it into a
+    // bounded queue; a background thread writes batches to the sinks.
+    void start_async(size_t capacity = 8192, LogOverflowPolicy policy = LogOverflowPolicy::Block)
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (queue_)
+            return;
+        policy_ = policy;
+        stop_.store(false, std::memory_order_relaxed);
+        written_.store(0, std::memory_order_relaxed);
+        queue_ = std::make_unique<LogRingBuffer>(capacity);
+        writer_ = std::thread([this]
+                              { writer_loop(); });
+    }
+
+    // Drain everything still queued, join the writer thread and return to synchronous logging.
+    // Must not race with threads that are still logging.
+    void stop_async()
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (!queue_)
+            return;
+        stop_.store(true, std::memory_order_seq_cst);
+        wake_writer();
+        writer_.join();
+        queue_.reset();
+    }
+
+    // Block until every record logged before this call has been written and the sinks flushed.
+    void flush()
+    {
+        if (queue_)
+        {
+            size_t target = queue_->enqueued();
+            wake_writer();
+            for (size_t done = written_.load(std::memory_order_acquire); done < target; done = written_.load(std::memory_order_acquire))
+                written_.wait(done, std::memory_order_acquire);
+        }
+        {
+            std::lock_guard<std::mutex> lock(binary_mutex_);
+            if (binary_stream_)
             {
-                os << std::filesystem::path(file).filename().string() << ":" << line << " ";
+                for (auto &buffer : binary_buffers_)
+                    drain(*buffer);
+                binary_stream_->flush();
             }
-        };
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_)
+            return;
+        std::cout.flush();
+        if (file_stream_ && file_stream_->is_open())
+            file_stream_->flush();
+    }
 
-        print_header(std::cout);
-        std::cout << msg << std::endl;
+    // Records discarded because the async queue was full.
+    uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
 
-        if (file_stream_ && file_stream_->is_open())
+    // Record rendering and printf-style formatting, shared with the binary log decoder.
+    // Appends "<date>_<time>.<ms>-[LEVEL] file:line msg\n" to out.
+    static void render_record(std::string &out, LogLevel level, std::chrono::system_clock::time_point time,
+                              std::string_view file, int line, std::string_view msg)
+    {
+        append_timestamp(out, time);
+        out += "-[";
+        out += level_to_string(level);
+        out += "] ";
+        if (line > 0)
         {
-            print_header(*file_stream_);
-            *file_stream_ << msg << std::endl;
+            out += file;
+            out += ':';
+            append_integer(out, line);
+            out += ' ';
         }
+        out += msg;
+        out += '\n';
     }
 
-private:
-    Logger() : level_(LogLevel::LOG_INFO) {}
-    ~Logger() = default;
+    static void render_record(std::string &out, const LogRecord &rec)
+    {
+        render_record(out, rec.level, rec.time, rec.file, rec.line, rec.msg);
+    }
 
-    LogLevel level_;
-    std::mutex mutex_;
-    std::unique_ptr<std::ofstream> file_stream_;
+    template <typename T>
+    static void append_integer(std::string &out, T value)
+    {
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, res.ptr);
+    }
 
-    static bool is_printf_style(std::string_view s)
+    // The zoned date/time text only changes once per second, so each thread keeps the last
+    // rendered second and only appends the milliseconds for records within it.
+    static void append_timestamp(std::string &out, std::chrono::system_clock::time_point time)
     {
-        for (size_t i = 0; i + 1 < s.size(); ++i)
+        struct SecondCache
         {
-            if (s[i] == '%')
-            {
-                if (s[i + 1] == '%')
-                {
-                    ++i;
-                    continue;
-                }
-                if (std::string_view("diuoxXfFeEgGaAcspn").find(s[i + 1]) != std::string_view::npos)
-                    return true;
-            }
+            long long second = std::numeric_limits<long long>::min();
+            std::string text;
+        };
+        thread_local SecondCache cache;
+
+        const long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+        long long second = ms / 1000;
+        long long millis = ms % 1000;
+        if (millis < 0)
+        {
+            millis += 1000;
+            --second;
         }
-        return false;
+
+        if (second != cache.second)
+        {
+            const auto time_in_s = std::chrono::sys_seconds(std::chrono::seconds(second));
+            const auto zoned_time = std::chrono::zoned_time(std::chrono::current_zone(), time_in_s);
+            cache.text = std::format("{:%Y-%m-%d_%H:%M:%S}", zoned_time);
+            cache.second = second;
+        }
+
+        out += cache.text;
+        out += '.';
+        out += static_cast<char>('0' + millis / 100);
+        out += static_cast<char>('0' + millis / 10 % 10);
+        out += static_cast<char>('0' + millis % 10);
     }
 
-    template <typename Tuple>
-    static std::string format_printf(std::string_view fmt, Tuple &tup)
+    // Arguments were matched to conversions at compile time, so they are consumed in order.
+    // Output is appended to out; nothing is allocated once out has grown to its working size.
+    template <typename... Args>
+    static void format_printf(std::string &out, std::string_view fmt, const Args &...args)
     {
-        std::ostringstream os;
-        size_t arg_index = 0;
-        size_t i = 0;
+        size_t pos = 0;
+        (format_one_arg(out, args, next_printf_spec(out, fmt, pos)), ...);
+        next_printf_spec(out, fmt, pos); // trailing literal text
+    }
 
-        while (i < fmt.size())
+    // Appends literal text from fmt[pos] up to the next conversion ("%%" becomes '%') and returns
+    // that conversion, or an empty view once the end of the string is reached.
+    static std::string_view next_printf_spec(std::string &out, std::string_view fmt, size_t &pos)
+    {
+        while (pos < fmt.size())
         {
-            size_t percent_pos = fmt.find('%', i);
+            size_t percent_pos = fmt.find('%', pos);
             if (percent_pos == std::string_view::npos)
             {
-                os << fmt.substr(i);
+                out += fmt.substr(pos);
                 break;
             }
 
-            os << fmt.substr(i, percent_pos - i);
+            out += fmt.substr(pos, percent_pos - pos);
 
             if (percent_pos + 1 >= fmt.size())
             {
-                os << '%'; // Dangling '%' at the end of the string
+                out += '%'; // Dangling '%' at the end of the string
                 break;
             }
 
             if (fmt[percent_pos + 1] == '%')
             {
-                os << '%';
-                i = percent_pos + 2;
+                out += '%';
+                pos = percent_pos + 2;
                 continue;
             }
 
-            size_t spec_end = fmt.find_first_of("diuoxXfFeEgGaAcspn", percent_pos + 1);
-
+            size_t spec_end = log_detail::printf_conversion_end(fmt, percent_pos);
             if (spec_end == std::string_view::npos)
             {
                 // Invalid format specifier, print literally
-                os << fmt.substr(percent_pos, 1);
-                i = percent_pos + 1;
+                out += '%';
+                pos = percent_pos + 1;
                 continue;
             }
 
-            std::string_view spec_group = fmt.substr(percent_pos, spec_end - percent_pos + 1);
-            os << format_printf_arg(tup, arg_index, spec_group);
+            pos = spec_end + 1;
+            return fmt.substr(percent_pos, spec_end - percent_pos + 1);
+        }
+        pos = fmt.size();
+        return {};
+    }
 
-            arg_index++;
-            i = spec_end + 1;
+    // snprintf into a stack buffer, or straight into out when the conversion is longer. out is only
+    // ever resized by what the conversion needs: resizing into all of its spare capacity would
+    // zero-fill it, and thread-local buffers keep the capacity of the longest message ever logged.
+    template <typename V>
+    static void append_snprintf(std::string &out, const char *spec, V value)
+    {
+        char buf[128];
+        int n = snprintf(buf, sizeof(buf), spec, value);
+        if (n < 0)
+            return;
+        if (static_cast<size_t>(n) < sizeof(buf))
+        {
+            out.append(buf, static_cast<size_t>(n));
+            return;
         }
-        return os.str();
+        const size_t old_size = out.size();
+        out.resize(old_size + n + 1);
+        snprintf(out.data() + old_size, n + 1, spec, value);
+        out.resize(old_size + n);
+    }
+
+    // Copies a printf conversion into a NUL-terminated buffer, replacing any C length modifier
+    // with `length` (arguments are widened to long long / double before the call).
+    static bool build_spec(char (&buf)[32], std::string_view spec_group, std::string_view length)
+    {
+        std::string_view body = spec_group.substr(0, spec_group.size() - 1);
+        while (!body.empty() && std::string_view("hljztLq").find(body.back()) != std::string_view::npos)
+            body.remove_suffix(1);
+        if (body.size() + length.size() + 2 > sizeof(buf))
+            return false;
+        char *p = std::copy(body.begin(), body.end(), buf);
+        p = std::copy(length.begin(), length.end(), p);
+        *p++ = spec_group.back();
+        *p = '\0';
+        return true;
     }
 
     template <typename T>
-    static std::string format_one_arg(const T &v, std::string_view spec_group)
+    static void format_one_arg(std::string &out, const T &v, std::string_view spec_group)
     {
-        char buffer[1024];
-        std::string fmt(spec_group);
+        auto format_error = [&]()
+        {
+            out += "[FORMAT_ERROR: Mismatch between ";
+            out += spec_group;
+            out += " and argument type]";
+        };
+
+        if (spec_group.empty())
+            return format_error();
+
+        const char spec_char = spec_group.back();
+        char spec[32];
 
-        char spec_char = ' ';
-        if (!spec_group.empty())
+        // Plain conversions skip snprintf entirely.
+        if (spec_group.size() == 2)
         {
-            for (size_t i = spec_group.length() - 1; i > 0; --i)
+            if constexpr (std::is_convertible_v<std::decay_t<T>, const char *>)
             {
-                if (isalpha(spec_group[i]))
+                if (spec_char == 's')
                 {
-                    spec_char = spec_group[i];
-                    break;
+                    const char *str = static_cast<const char *>(v);
+                    return void(out += str ? str : "(null)"); // what snprintf prints
                 }
             }
+            else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+            {
+                if (spec_char == 's')
+                    return void(out += v);
+            }
+            else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+            {
+                if (spec_char == 'd' || spec_char == 'i')
+                    return append_integer(out, static_cast<long long>(v));
+                if (spec_char == 'u')
+                    return append_integer(out, static_cast<unsigned long long>(static_cast<std::make_unsigned_t<T>>(v)));
+            }
         }
 
-        auto format_error = [&]() -> std::string {
-            std::ostringstream oss;
-            oss << "[FORMAT_ERROR: Mismatch between " << fmt << " and argument type]";
-            return oss.str();
-        };
-
         switch (spec_char)
         {
         case 's':
             if constexpr (std::is_convertible_v<std::decay_t<T>, const char *>)
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), v);
-            else if constexpr (std::is_same_v<std::decay_t<T>, std::string> || std::is_same_v<std::decay_t<T>, std::string_view>)
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), std::string(v).c_str());
-            else
-                return format_error();
+            {
+                const char *str = static_cast<const char *>(v);
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, str ? str : "(null)");
+            }
+            else if constexpr (std::is_same_v<T, std::string>)
+            {
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, v.c_str());
+            }
+            else if constexpr (std::is_same_v<T, std::string_view>)
+            {
+                // string_view is not NUL-terminated; stage it in a reusable per-thread string.
+                thread_local std::string scratch;
+                scratch.assign(v);
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, scratch.c_str());
+            }
             break;
 
         case 'd':
         case 'i':
+            if constexpr (std::is_integral_v<T>)
+            {
+                if (build_spec(spec, spec_group, "ll"))
+                    return append_snprintf(out, spec, static_cast<long long>(v));
+            }
+            break;
+
         case 'u':
         case 'o':
         case 'x':
         case 'X':
-            if constexpr (std::is_integral_v<T> || std::is_same_v<T, bool>)
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), static_cast<long long>(v));
-            else
-                return format_error();
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                if (build_spec(spec, spec_group, "ll"))
+                    return append_snprintf(out, spec, static_cast<unsigned long long>(v));
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                if (build_spec(spec, spec_group, "ll"))
+                    return append_snprintf(out, spec, static_cast<unsigned long long>(static_cast<std::make_unsigned_t<T>>(v)));
+            }
             break;
 
         case 'f':
@@ -273,43 +1042,283 @@ private:
         case 'a':
         case 'A':
             if constexpr (std::is_floating_point_v<T>)
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), static_cast<double>(v));
-            else
-                return format_error();
+            {
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, static_cast<double>(v));
+            }
             break;
 
         case 'c':
             if constexpr (std::is_integral_v<T>) // char is promoted to int
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), static_cast<int>(v));
-            else
-                return format_error();
+            {
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, static_cast<int>(v));
+            }
             break;
 
         case 'p':
-            if constexpr (std::is_pointer_v<T>)
-                snprintf(buffer, sizeof(buffer), fmt.c_str(), v);
-            else
-                return format_error();
+            if constexpr (std::is_pointer_v<std::decay_t<T>>)
+            {
+                if (build_spec(spec, spec_group, ""))
+                    return append_snprintf(out, spec, static_cast<const void *>(v));
+            }
             break;
 
         default:
-            return format_error();
+            break;
+        }
+        format_error();
+    }
+
+private:
+    Logger() : level_(LogLevel::LOG_INFO) {}
+    ~Logger()
+    {
+        stop_async();
+        set_binary_logfile("");
+    }
+
+    std::atomic<LogLevel> level_;
+    std::mutex mutex_;
+    std::unique_ptr<std::ofstream> file_stream_;
+
+    // Async backend state
+    std::mutex async_mutex_;
+    std::unique_ptr<LogRingBuffer> queue_;
+    std::thread writer_;
+    LogOverflowPolicy policy_ = LogOverflowPolicy::Block;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> writer_sleeping_{false};
+    std::atomic<uint32_t> wake_seq_{0};
+    std::atomic<size_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t dropped_reported_ = 0;
+    std::string batch_buf_; // writer thread only
+
+    // Records of one thread waiting to be written to the binary log. Its thread appends under
+    // the buffer's own lock, which nobody else takes except to drain it.
+    struct BinaryBuffer
+    {
+        std::mutex mutex;
+        std::string data;
+        uint32_t session = 0;    // the session sites refers to
+        std::vector<bool> sites; // sites already described in this buffer during that session
+    };
+    static constexpr size_t binary_block = 64 * 1024; // a thread writes out at this size
+
+    // Binary sink state (guarded by binary_mutex_; lock order binary_mutex_, then a buffer's)
+    std::mutex binary_mutex_;
+    std::atomic<bool> binary_enabled_{false};
+    std::atomic<uint32_t> next_site_id_{0};
+    std::atomic<uint32_t> binary_session_{0};
+    std::unique_ptr<std::ofstream> binary_stream_;
+    std::vector<char> binary_buf_;
+    std::vector<std::shared_ptr<BinaryBuffer>> binary_buffers_;
+
+    // The calling thread's buffer, registered on first use and drained when the thread exits.
+    BinaryBuffer &thread_binary_buffer()
+    {
+        struct Holder
+        {
+            std::shared_ptr<BinaryBuffer> buffer = std::make_shared<BinaryBuffer>();
+            Holder()
+            {
+                Logger &logger = Logger::get();
+                std::lock_guard<std::mutex> lock(logger.binary_mutex_);
+                logger.binary_buffers_.push_back(buffer);
+            }
+            ~Holder()
+            {
+                Logger &logger = Logger::get();
+                std::lock_guard<std::mutex> lock(logger.binary_mutex_);
+                logger.drain(*buffer);
+                std::erase(logger.binary_buffers_, buffer);
+            }
+        };
+        thread_local Holder holder;
+        return *holder.buffer;
+    }
+
+    // Writes out what buffer holds. Call with binary_mutex_ held.
+    void drain(BinaryBuffer &buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        if (binary_stream_ && !buffer.data.empty())
+            binary_stream_->write(buffer.data.data(), static_cast<std::streamsize>(buffer.data.size()));
+        buffer.data.clear();
+    }
+
+    uint32_t assign_site_id(LogSite &site)
+    {
+        uint32_t expected = 0;
+        uint32_t id = next_site_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (site.id.compare_exchange_strong(expected, id, std::memory_order_acq_rel))
+            return id;
+        return expected; // another thread won the race
+    }
+
+    template <typename... Args>
+    void write_binary(LogLevel level, LogSite &site, std::string_view fmt, bool printf_style, uint64_t pointer_args,
+                      std::chrono::system_clock::time_point time, const Args &...args)
+    {
+        using namespace log_binary;
+        uint32_t id = site.id.load(std::memory_order_acquire);
+        if (id == 0)
+            id = assign_site_id(site);
+
+        thread_local std::string rec;
+        rec.clear();
+        put(rec, RecordKind::Message);
+        put(rec, id);
+        put(rec, static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count()));
+        const size_t len_pos = rec.size();
+        put(rec, uint32_t{0});
+        size_t index = 0;
+        [[maybe_unused]] auto encode = [&](const auto &v)
+        {
+            if constexpr (log_detail::arg_kind<decltype(v)>() == log_detail::ArgKind::Other)
+                encode_arg(rec, v, false, printf_style ? std::string() : field_spec(fmt, index, args...));
+            else
+                encode_arg(rec, v, index < 64 && (pointer_args >> index & 1));
+            ++index;
+        };
+        (encode(args), ...);
+        const auto args_len = static_cast<uint32_t>(rec.size() - len_pos - sizeof(uint32_t));
+        std::memcpy(rec.data() + len_pos, &args_len, sizeof(args_len));
+
+        BinaryBuffer &buffer = thread_binary_buffer();
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            // Buffers are written out whole, so a site described in this one precedes its
+            // messages in the file no matter how the threads' blocks interleave.
+            const uint32_t session = binary_session_.load(std::memory_order_relaxed);
+            if (buffer.session != session)
+            {
+                buffer.session = session;
+                buffer.sites.clear();
+            }
+            if (id >= buffer.sites.size())
+                buffer.sites.resize(id + 1);
+            if (!buffer.sites[id])
+            {
+                put(buffer.data, RecordKind::Site);
+                put(buffer.data, id);
+                put(buffer.data, static_cast<uint8_t>(level));
+                put(buffer.data, static_cast<uint8_t>(printf_style));
+                put(buffer.data, static_cast<uint32_t>(site.line));
+                put(buffer.data, static_cast<uint16_t>(site.file.size()));
+                buffer.data += site.file;
+                put(buffer.data, static_cast<uint32_t>(fmt.size()));
+                buffer.data += fmt;
+                buffer.sites[id] = true;
+            }
+            buffer.data += rec;
+            full = buffer.data.size() >= binary_block;
+        }
+        if (full || level == LogLevel::LOG_FATAL)
+        {
+            std::lock_guard<std::mutex> lock(binary_mutex_);
+            drain(buffer);
+            if (level == LogLevel::LOG_FATAL && binary_stream_)
+                binary_stream_->flush();
         }
-        return buffer;
     }
 
-    template <std::size_t I = 0, typename Tuple>
-    static std::string format_printf_arg(Tuple &tup, size_t index, std::string_view spec_group)
+    void enqueue(LogLevel level, std::chrono::system_clock::time_point time, std::string_view file, int line, std::string_view msg)
     {
-        if constexpr (I < std::tuple_size_v<std::remove_reference_t<Tuple>>)
+        auto fill = [&](LogRecord &rec)
         {
-            if (I == index)
+            rec.level = level;
+            rec.time = time;
+            rec.file = file;
+            rec.line = line;
+            rec.msg.assign(msg);
+        };
+
+        // FATAL records are never dropped and are on the sinks before the call returns.
+        const bool fatal = level == LogLevel::LOG_FATAL;
+        const bool block = fatal || policy_ == LogOverflowPolicy::Block;
+        while (!queue_->try_push(fill))
+        {
+            if (!block)
             {
-                return format_one_arg(std::get<I>(tup), spec_group);
+                if (policy_ == LogOverflowPolicy::DropAndCount)
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
             }
-            return format_printf_arg<I + 1>(tup, index, spec_group);
+            wake_writer();
+            std::this_thread::yield();
         }
-        return "[missing arg]";
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writer_sleeping_.load(std::memory_order_relaxed))
+            wake_writer();
+        if (fatal)
+            flush();
+    }
+
+    void wake_writer()
+    {
+        wake_seq_.fetch_add(1, std::memory_order_seq_cst);
+        wake_seq_.notify_one();
+    }
+
+    void writer_loop()
+    {
+        for (;;)
+        {
+            uint32_t seq = wake_seq_.load(std::memory_order_seq_cst);
+            bool stopping = stop_.load(std::memory_order_seq_cst);
+
+            if (!queue_->empty() || dropped_.load(std::memory_order_relaxed) != dropped_reported_)
+            {
+                write_batch();
+                continue;
+            }
+            if (stopping)
+                break;
+
+            writer_sleeping_.store(true, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (queue_->empty())
+                wake_seq_.wait(seq, std::memory_order_seq_cst);
+            writer_sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Write everything currently published in one go and flush each sink once.
+    void write_batch()
+    {
+        constexpr size_t max_batch = 1024;
+        batch_buf_.clear();
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported_)
+        {
+            LogRecord note{LogLevel::LOG_WARNING, std::chrono::system_clock::now(), {}, 0,
+                           std::format("Logger queue overflow: {} record(s) dropped", dropped - dropped_reported_)};
+            dropped_reported_ = dropped;
+            render_record(batch_buf_, note);
+        }
+
+        size_t n = 0;
+        while (n < max_batch)
+        {
+            LogRecord *rec = queue_->front();
+            if (!rec)
+                break;
+            render_record(batch_buf_, *rec);
+            queue_->release();
+            ++n;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::cout.write(batch_buf_.data(), static_cast<std::streamsize>(batch_buf_.size())).flush();
+        if (file_stream_ && file_stream_->is_open())
+            file_stream_->write(batch_buf_.data(), static_cast<std::streamsize>(batch_buf_.size())).flush();
+
+        written_.store(queue_->dequeued(), std::memory_order_release);
+        written_.notify_all();
     }
 
     static const char *level_to_string(LogLevel level)
@@ -336,11 +1345,27 @@ private:
     }
 };
 
-// Use macros to automatically capture file and line number
-#define LOG_TRACE(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_TRACE, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_DEBUG(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_DEBUG, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_INFO(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_STEP(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_STEP, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_WARNING(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_WARNING, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_ERROR(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_ERROR, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
-#define LOG_FATAL(fmt, ...) (Logger::get().log_impl(LogLevel::LOG_FATAL, __FILE__, __LINE__, fmt, ##__VA_ARGS__))
+// Use macros to automatically capture file and line number.
+// The level is checked before the arguments are evaluated, and levels below
+// LIBUTILS_LOG_MIN_LEVEL fold to a constant false so the call site disappears.
+// Each call site owns a constant-initialized LogSite, so taking it costs nothing.
+#define LIBUTILS_LOG_SITE()                                                          \
+    ([]() -> LogSite & {                                                             \
+        static LogSite site{log_detail::source_basename(__FILE__), __LINE__};        \
+        return site; }())
+
+#define LIBUTILS_LOG(lvl, fmt, ...)                                                  \
+    ((static_cast<int>(lvl) >= LIBUTILS_LOG_MIN_LEVEL && Logger::get().enabled(lvl)) \
+         ? Logger::get().log_impl(lvl, LIBUTILS_LOG_SITE(), fmt, ##__VA_ARGS__)      \
+         : void())
+
+// Bypasses both the runtime level and LIBUTILS_LOG_MIN_LEVEL; see Logger::log_unfiltered.
+#define LOG_UNFILTERED(lvl, fmt, ...) Logger::get().log_unfiltered(lvl, LIBUTILS_LOG_SITE(), fmt, ##__VA_ARGS__)
+
+#define LOG_TRACE(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_TRACE, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_INFO, fmt, ##__VA_ARGS__)
+#define LOG_STEP(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_STEP, fmt, ##__VA_ARGS__)
+#define LOG_WARNING(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_WARNING, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_FATAL(fmt, ...) LIBUTILS_LOG(LogLevel::LOG_FATAL, fmt, ##__VA_ARGS__)
@@ -1,10 +1,73 @@
 @echo off
-setlocal
+setlocal EnableDelayedExpansion
+
+rem Usage: make.cmd [options] <tool>.cpp [more sources]   build into build\ (build\<profile>\ with -p)
+rem        make.cmd [options] bench                       build every bench\*.cpp into build\<profile>\bench\
+rem        make.cmd clean
+rem Options:
+rem   -p <Debug|Release|RelWithDebInfo>   without -p tools get the usual /Zi /O2; benches get Release
+rem   --lto                               whole program optimization (/GL, /LTCG)
+rem   --arch <AVX2|AVX512|...>            passed to /arch:
 
 if "%1"=="clean" goto clean
 
-set SOURCES=%*
+set PROFILE=
+set LTO=
+set ARCH=
+
+:options
+if /i "%~1"=="-p" (
+    set PROFILE=%~2
+    shift
+    shift
+    goto options
+)
+if /i "%~1"=="--lto" (
+    set LTO=1
+    shift
+    goto options
+)
+if /i "%~1"=="--arch" (
+    set ARCH=%~2
+    shift
+    shift
+    goto options
+)
+
+if "%PROFILE%"=="" if /i "%~1"=="bench" set PROFILE=Release
+
+set OUTDIR=build
+if "%PROFILE%"=="" (
+    set CMD_OPTS=/EHsc /std:c++20 /W2 /WX /permissive- /Zi /O2 /MT
+) else if /i "%PROFILE%"=="Debug" (
+    set CMD_OPTS=/EHsc /std:c++20 /W2 /WX /permissive- /Zi /Od /MTd
+) else if /i "%PROFILE%"=="Release" (
+    set CMD_OPTS=/EHsc /std:c++20 /W2 /WX /permissive- /O2 /MT /DNDEBUG
+    set OUTDIR=build\%PROFILE%
+) else if /i "%PROFILE%"=="RelWithDebInfo" (
+    set CMD_OPTS=/EHsc /std:c++20 /W2 /WX /permissive- /Zi /O2 /MT /DNDEBUG
+    set OUTDIR=build\%PROFILE%
+) else (
+    echo Unknown profile: %PROFILE% ^(use Debug, Release or RelWithDebInfo^)
+    exit /b 1
+)
+set LINK_OPTS=
+if "%LTO%"=="1" (
+    set CMD_OPTS=!CMD_OPTS! /GL
+    set LINK_OPTS=/link /LTCG
+)
+if not "%ARCH%"=="" set CMD_OPTS=!CMD_OPTS! /arch:%ARCH%
+
+if /i "%~1"=="bench" goto bench
+
+set SOURCES=
 set MAIN=%1
+:sources
+if "%~1"=="" goto sources_done
+set SOURCES=%SOURCES% %1
+shift
+goto sources
+:sources_done
 
 for %%F in (%MAIN%) do (
     set MAIN_NAME=%%~nF
@@ -12,15 +75,36 @@ for %%F in (%MAIN%) do (
 )
 if "%ext%"=="" set ext=.cpp
 
-if not exist build mkdir build
-
-set CMD_OPTS=/EHsc /std:c++20 /W2 /WX /permissive- /Zi /O2 /MT 
-set EXECUTABLE_NAME=%MAIN_NAME%.exe
+call :build %MAIN_NAME% %OUTDIR% %SOURCES%
+goto :EOF
 
-echo cl.exe %CMD_OPTS% /Fo:build\ /Fd:build\%MAIN_NAME%.pdb /Fe:build\%EXECUTABLE_NAME% %SOURCES%
-cl.exe %CMD_OPTS% /Fo:build\ /Fd:build\%MAIN_NAME%.pdb /Fe:build\%EXECUTABLE_NAME% %SOURCES%
+:bench
+set RC=0
+for %%F in (bench\*.cpp) do (
+    set EXTRA=
+    if "%%~nF"=="offset2lba_bench" set EXTRA=offset2lba_windows.cpp
+    if "%%~nF"=="diskrw_bench" set EXTRA=diskrw_windows.cpp offset2lba_windows.cpp
+    call :build %%~nF %OUTDIR%\bench %%F !EXTRA! || set RC=1
+)
+exit /b %RC%
 
-goto :EOF
+rem :build <name> <outdir> <sources...>
+:build
+set NAME=%1
+set DIR=%2
+shift
+shift
+set FILES=
+:build_files
+if "%~1"=="" goto build_run
+set FILES=%FILES% %1
+shift
+goto build_files
+:build_run
+if not exist %DIR% mkdir %DIR%
+echo cl.exe %CMD_OPTS% /Fo:%DIR%\ /Fd:%DIR%\%NAME%.pdb /Fe:%DIR%\%NAME%.exe %FILES% %LINK_OPTS%
+cl.exe %CMD_OPTS% /Fo:%DIR%\ /Fd:%DIR%\%NAME%.pdb /Fe:%DIR%\%NAME%.exe %FILES% %LINK_OPTS%
+exit /b %ERRORLEVEL%
 
 :clean
 if exist build rd /s /q build
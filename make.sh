@@ -1,18 +1,90 @@
 #!/bin/bash
+# Usage: ./make.sh [options] <tool>.cpp     build one tool into build/ (build/<profile>/ unless Debug)
+#        ./make.sh [options] bench          build every bench/*.cpp into build/<profile>/bench/
+#        ./make.sh clean
+# Options:
+#   -p, --profile <Debug|Release|RelWithDebInfo>  Debug is -g -O0 (the default for tools);
+#                                                 benches default to Release
+#   --lto                                         link-time optimization
+#   --march <arch>                                e.g. native, x86-64-v3
+# PROFILE, LTO=1 and MARCH in the environment do the same.
+
+PROFILE=${PROFILE:-}
+LTO=${LTO:-0}
+MARCH=${MARCH:-}
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+    -p | --profile)
+        PROFILE=$2
+        shift 2
+        ;;
+    --lto)
+        LTO=1
+        shift
+        ;;
+    --march)
+        MARCH=$2
+        shift 2
+        ;;
+    *) break ;;
+    esac
+done
 
 PARAM=${1:-"op_copy.cpp"}
-fname=$(echo "$PARAM" | cut -d'.' -f1)
-ext=$(echo "$PARAM" | cut -s -d'.' -f2)
-ext=${ext:-"cpp"}
 
-files=""
+if [ "$PARAM" = "clean" ]; then
+    rm -rf build
+    echo "Cleaned build directory."
+    exit 0
+fi
 
-if [ "$fname" = "offset2lba" ]; then
-    files="offset2lba_linux.cpp"
+if [ -z "$PROFILE" ]; then
+    [ "$PARAM" = "bench" ] && PROFILE=Release || PROFILE=Debug
 fi
 
+case "$PROFILE" in
+Debug) flags="-g -O0" ;;
+Release) flags="-O2 -DNDEBUG" ;;
+RelWithDebInfo) flags="-O2 -g -DNDEBUG" ;;
+*)
+    echo "Unknown profile: $PROFILE (use Debug, Release or RelWithDebInfo)"
+    exit 1
+    ;;
+esac
+[ "$LTO" = "1" ] && flags="$flags -flto=auto"
+[ -n "$MARCH" ] && flags="$flags -march=$MARCH"
+
 outdir="build"
-mkdir -p "$outdir"
+[ "$PROFILE" != "Debug" ] && outdir="build/$PROFILE"
+
+# Platform sources a tool links besides its own.
+extra_sources() {
+    case "$1" in
+    offset2lba | test | offset2lba_bench) echo "offset2lba_linux.cpp" ;;
+    diskrw | diskrw_bench) echo "diskrw_linux.cpp offset2lba_linux.cpp" ;;
+    esac
+}
+
+# build <source> <output>
+build() {
+    local files
+    files=$(extra_sources "$(basename "$2")")
+    mkdir -p "$(dirname "$2")"
+    echo g++ -std=c++2a -Wall $flags -static -o "$2" "$1" $files
+    g++ -std=c++2a -Wall $flags -static -o "$2" "$1" $files
+}
+
+if [ "$PARAM" = "bench" ]; then
+    rc=0
+    for src in bench/*.cpp; do
+        build "$src" "$outdir/bench/$(basename "$src" .cpp)" || rc=1
+    done
+    exit $rc
+fi
+
+fname=$(echo "$PARAM" | cut -d'.' -f1)
+ext=$(echo "$PARAM" | cut -s -d'.' -f2)
+ext=${ext:-"cpp"}
 
-echo g++ -std=c++2a -Wall -g -O0 -static -o "$outdir/$fname" "$fname.$ext" $files
-g++ -std=c++2a -Wall -g -O0 -static -o "$outdir/$fname" "$fname.$ext" $files
\ No newline at end of file
+build "$fname.$ext" "$outdir/$fname"
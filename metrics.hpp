@@ -0,0 +1,364 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "logger.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Hot-path instrumentation: named counters, value histograms and scoped timers.
+//
+//   METRIC_ADD("libpath.bytes", n);        counter
+//   METRIC_RECORD("diskrw.latency_ns", v); histogram
+//   METRIC_TIMER("test.compare_ns");       histogram of the enclosing scope's duration in ns
+//
+// Names must be string literals: each call site resolves its name once and keeps the id.
+// Every thread records into its own slot, so a sample is a load and a store on memory that no
+// other thread writes: no contended atomics, no locks. Snapshots sum the slots.
+// Build with -DLIBUTILS_METRICS=0 and every METRIC_* site compiles out (arguments are never
+// evaluated), like log calls below LIBUTILS_LOG_MIN_LEVEL.
+#ifndef LIBUTILS_METRICS
+#define LIBUTILS_METRICS 1
+#endif
+
+namespace metrics
+{
+    enum class Kind
+    {
+        Counter,
+        Histogram,
+    };
+
+    inline constexpr size_t max_counters = 128;
+    inline constexpr size_t max_histograms = 32;
+    inline constexpr size_t not_registered = SIZE_MAX;
+
+    // Power-of-two buckets: bucket 0 counts zeros, bucket i values in [2^(i-1), 2^i).
+    struct HistogramSlot
+    {
+        std::array<std::atomic<uint64_t>, 65> buckets{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    // Written only by the thread that holds it; the atomics just let a snapshot read it meanwhile.
+    struct ThreadSlot
+    {
+        std::array<std::atomic<uint64_t>, max_counters> counters{};
+        std::array<HistogramSlot, max_histograms> histograms{};
+    };
+
+    inline void bump(std::atomic<uint64_t> &a, uint64_t n)
+    {
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct CounterValue
+    {
+        std::string name;
+        uint64_t value = 0;
+    };
+
+    struct HistogramValue
+    {
+        std::string name;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        std::array<uint64_t, 65> buckets{};
+
+        double mean() const { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0; }
+
+        // Upper end of the bucket holding the q-th sample, capped at the exact maximum.
+        uint64_t percentile(double q) const
+        {
+            if (count == 0)
+                return 0;
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(count) + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); ++i)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                    return i == 0 ? 0 : std::min(i >= 64 ? UINT64_MAX : (uint64_t{1} << i) - 1, max);
+            }
+            return max;
+        }
+    };
+
+    struct Snapshot
+    {
+        std::vector<CounterValue> counters;
+        std::vector<HistogramValue> histograms;
+
+        bool empty() const { return counters.empty() && histograms.empty(); }
+    };
+
+    // Names and thread slots. Slots of finished threads keep their values (they are part of the
+    // totals) and are handed to the next new thread, so short-lived threads do not pile up slots.
+    class Registry
+    {
+    public:
+        static Registry &get()
+        {
+            static Registry instance;
+            return instance;
+        }
+
+        // The id of name, registered on first use; not_registered once the table is full.
+        size_t id(std::string_view name, Kind kind)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &names = kind == Kind::Counter ? counter_names_ : histogram_names_;
+            for (size_t i = 0; i < names.size(); ++i)
+                if (names[i] == name)
+                    return i;
+            if (names.size() == (kind == Kind::Counter ? max_counters : max_histograms))
+            {
+                std::cerr << "metrics: no room for " << name << ", not recorded" << std::endl;
+                return not_registered;
+            }
+            names.emplace_back(name);
+            return names.size() - 1;
+        }
+
+        ThreadSlot *acquire()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty())
+            {
+                ThreadSlot *slot = free_.back();
+                free_.pop_back();
+                return slot;
+            }
+            slots_.push_back(std::make_unique<ThreadSlot>());
+            return slots_.back().get();
+        }
+
+        void release(ThreadSlot *slot)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(slot);
+        }
+
+        Snapshot snapshot()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Snapshot snap;
+            for (size_t i = 0; i < counter_names_.size(); ++i)
+            {
+                CounterValue c{counter_names_[i]};
+                for (const auto &slot : slots_)
+                    c.value += slot->counters[i].load(std::memory_order_relaxed);
+                snap.counters.push_back(std::move(c));
+            }
+            for (size_t i = 0; i < histogram_names_.size(); ++i)
+            {
+                HistogramValue h{histogram_names_[i]};
+                for (const auto &slot : slots_)
+                {
+                    const HistogramSlot &s = slot->histograms[i];
+                    for (size_t b = 0; b < h.buckets.size(); ++b)
+                    {
+                        uint64_t n = s.buckets[b].load(std::memory_order_relaxed);
+                        h.buckets[b] += n;
+                        h.count += n;
+                    }
+                    h.sum += s.sum.load(std::memory_order_relaxed);
+                    h.max = std::max(h.max, s.max.load(std::memory_order_relaxed));
+                }
+                snap.histograms.push_back(std::move(h));
+            }
+            return snap;
+        }
+
+    private:
+        Registry() = default;
+
+        std::mutex mutex_;
+        std::vector<std::string> counter_names_;
+        std::vector<std::string> histogram_names_;
+        std::vector<std::unique_ptr<ThreadSlot>> slots_;
+        std::vector<ThreadSlot *> free_;
+    };
+
+    inline ThreadSlot &local()
+    {
+        struct Holder
+        {
+            ThreadSlot *slot = Registry::get().acquire();
+            ~Holder() { Registry::get().release(slot); }
+        };
+        thread_local Holder holder;
+        return *holder.slot;
+    }
+
+    // One per METRIC_* call site, so the name is looked up once.
+    struct Site
+    {
+        size_t id;
+        Site(std::string_view name, Kind kind) : id(Registry::get().id(name, kind)) {}
+    };
+
+    inline void add(const Site &site, uint64_t n)
+    {
+        if (site.id != not_registered)
+            bump(local().counters[site.id], n);
+    }
+
+    inline void record(const Site &site, uint64_t value)
+    {
+        if (site.id == not_registered)
+            return;
+        HistogramSlot &h = local().histograms[site.id];
+        bump(h.buckets[static_cast<size_t>(std::bit_width(value))], 1);
+        bump(h.sum, value);
+        if (value > h.max.load(std::memory_order_relaxed))
+            h.max.store(value, std::memory_order_relaxed);
+    }
+
+    // Records the nanoseconds between construction and destruction.
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(const Site &site) : site_(site), start_(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            record(site_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count()));
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        const Site &site_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    inline std::string to_json(const Snapshot &snap)
+    {
+        std::string out = "{\"counters\":{";
+        for (size_t i = 0; i < snap.counters.size(); ++i)
+            out += std::format("{}\"{}\":{}", i ? "," : "", snap.counters[i].name, snap.counters[i].value);
+        out += "},\"histograms\":{";
+        for (size_t i = 0; i < snap.histograms.size(); ++i)
+        {
+            const HistogramValue &h = snap.histograms[i];
+            out += std::format("{}\"{}\":{{\"count\":{},\"sum\":{},\"mean\":{:.1f},\"p50\":{},\"p99\":{},\"max\":{}}}", i ? "," : "", h.name, h.count,
+                               h.sum, h.mean(), h.percentile(0.50), h.percentile(0.99), h.max);
+        }
+        return out + "}}";
+    }
+
+    enum class Format
+    {
+        Step, // one STEP record per metric
+        Json, // one STEP record "metrics {...}"
+    };
+
+    inline std::optional<Format> parse_format(std::string_view name)
+    {
+        if (name == "step")
+            return Format::Step;
+        if (name == "json")
+            return Format::Json;
+        return std::nullopt;
+    }
+
+    // Logs the current totals. Metrics nobody has recorded into yet (count 0) are left out of the
+    // STEP summary.
+    inline void dump(Format format)
+    {
+        Snapshot snap = Registry::get().snapshot();
+        if (snap.empty())
+            return;
+        if (format == Format::Json)
+        {
+            LOG_UNFILTERED(LogLevel::LOG_STEP, "metrics {}", to_json(snap));
+            return;
+        }
+        for (const CounterValue &c : snap.counters)
+            if (c.value)
+                LOG_UNFILTERED(LogLevel::LOG_STEP, "metric {}: {}", c.name, c.value);
+        for (const HistogramValue &h : snap.histograms)
+            if (h.count)
+                LOG_UNFILTERED(LogLevel::LOG_STEP, "metric {}: {} samples, mean {:.1f}, p50 {}, p99 {}, max {}", h.name, h.count,
+                               h.mean(), h.percentile(0.50), h.percentile(0.99), h.max);
+    }
+
+    // Dumps every interval (if not zero) from a background thread and once more when destroyed.
+    class Reporter
+    {
+    public:
+        explicit Reporter(Format format, std::chrono::seconds interval = std::chrono::seconds(0)) : format_(format)
+        {
+            if (interval.count() > 0)
+            {
+                thread_ = std::thread([this, interval]
+                                      {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    while (!cv_.wait_for(lock, interval, [this] { return stop_; }))
+                    {
+                        lock.unlock();
+                        dump(format_);
+                        lock.lock();
+                    } });
+            }
+        }
+
+        ~Reporter()
+        {
+            if (thread_.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                cv_.notify_one();
+                thread_.join();
+            }
+            dump(format_);
+        }
+
+        Reporter(const Reporter &) = delete;
+        Reporter &operator=(const Reporter &) = delete;
+
+    private:
+        Format format_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool stop_ = false;
+        std::thread thread_;
+    };
+} // namespace metrics
+
+#if LIBUTILS_METRICS
+#define LIBUTILS_METRIC_CONCAT_(a, b) a##b
+#define LIBUTILS_METRIC_CONCAT(a, b) LIBUTILS_METRIC_CONCAT_(a, b)
+#define LIBUTILS_METRIC_SITE(name, kind)                          \
+    ([]() -> const metrics::Site & {                              \
+        static const metrics::Site site{name, metrics::Kind::kind}; \
+        return site;                                              \
+    }())
+#define METRIC_ADD(name, n) metrics::add(LIBUTILS_METRIC_SITE(name, Counter), static_cast<uint64_t>(n))
+#define METRIC_INC(name) METRIC_ADD(name, 1)
+#define METRIC_RECORD(name, value) metrics::record(LIBUTILS_METRIC_SITE(name, Histogram), static_cast<uint64_t>(value))
+#define METRIC_TIMER(name) metrics::ScopedTimer LIBUTILS_METRIC_CONCAT(metric_timer_, __LINE__)(LIBUTILS_METRIC_SITE(name, Histogram))
+#else
+#define METRIC_ADD(name, n) ((void)0)
+#define METRIC_INC(name) ((void)0)
+#define METRIC_RECORD(name, value) ((void)0)
+#define METRIC_TIMER(name) ((void)0)
+#endif
+
+#endif // METRICS_HPP
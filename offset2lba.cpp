@@ -1,8 +1,15 @@
 #include "offset2lba.hpp"
+#include "blockio.hpp"
+#include "argparser.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <cctype>
+#include <cstdio>
 #include <system_error>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h> // For WideCharToMultiByte
@@ -17,31 +24,390 @@ std::string to_string(const std::wstring &wstr)
     WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
     return strTo;
 }
-int wmain(int argc, wchar_t *argv[])
-#else
-int main(int argc, char *argv[])
 #endif
+
+using namespace argparse;
+
+// Reads one offset per line; blank lines and lines starting with '#' are skipped.
+static bool read_offsets(std::istream &is, std::vector<unsigned long long> &offsets)
 {
-    if (argc != 3)
+    std::string line;
+    while (std::getline(is, line))
     {
-#ifdef _WIN32
-        LOG_FATAL("Usage: {} <file_path> <offset>", to_string(fs::path(argv[0]).filename().wstring()));
-#else
-        LOG_FATAL("Usage: {} <file_path> <offset>", fs::path(argv[0]).filename().string());
-#endif
+        std::string_view sv = line;
+        while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.back())))
+            sv.remove_suffix(1);
+        while (!sv.empty() && std::isspace(static_cast<unsigned char>(sv.front())))
+            sv.remove_prefix(1);
+        if (sv.empty() || sv.front() == '#')
+            continue;
+        auto offset = parse_integer<unsigned long long>(sv);
+        if (!offset)
+        {
+            LOG_ERROR("Invalid offset: {}", sv);
+            return false;
+        }
+        offsets.push_back(*offset);
+    }
+    return true;
+}
+
+// Escapes a string for use inside a JSON or CSV double-quoted field.
+static std::string quote_escape(const std::string &s, bool json)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s)
+    {
+        if (c == '"')
+            out += json ? "\\\"" : "\"\"";
+        else if (json && c == '\\')
+            out += "\\\\";
+        else
+            out += c;
+    }
+    return out;
+}
+
+// Streams batch results as CSV or as a JSON array.
+class ResultWriter
+{
+public:
+    explicit ResultWriter(bool json) : json_(json)
+    {
+        std::fputs(json_ ? "[\n" : "offset,mapped,physical_offset,fs_lba,absolute_lba,sector_size,flags,disk\n", stdout);
+    }
+
+    ~ResultWriter()
+    {
+        if (json_)
+            std::fputs(first_ ? "]\n" : "\n]\n", stdout);
+        std::fflush(stdout);
+    }
+
+    void operator()(const LbaResult &r)
+    {
+        if (json_)
+        {
+            std::fputs(first_ ? "  " : ",\n  ", stdout);
+            if (r.mapped)
+                std::printf("{\"offset\": %llu, \"mapped\": true, \"physical_offset\": %llu, \"fs_lba\": %llu, "
+                            "\"absolute_lba\": %llu, \"sector_size\": %u, \"flags\": %u, \"disk\": \"%s\"}",
+                            r.offset, r.physical_offset, r.fs_lba, r.absolute_lba, r.sector_size, r.flags,
+                            quote_escape(r.disk, true).c_str());
+            else
+                std::printf("{\"offset\": %llu, \"mapped\": false, \"flags\": %u}", r.offset, r.flags);
+        }
+        else
+        {
+            if (r.mapped)
+                std::printf("%llu,1,%llu,%llu,%llu,%u,0x%x,\"%s\"\n", r.offset, r.physical_offset, r.fs_lba, r.absolute_lba,
+                            r.sector_size, r.flags, quote_escape(r.disk, false).c_str());
+            else
+                std::printf("%llu,0,,,,,0x%x,\n", r.offset, r.flags);
+        }
+        first_ = false;
+    }
+
+private:
+    bool json_;
+    bool first_ = true;
+};
+
+// --sync / --no-sync; nullopt if both were given.
+static std::optional<bool> sync_option(const ArgParser &parser)
+{
+    if (parser.is_set("sync") && parser.is_set("no-sync"))
+    {
+        LOG_FATAL("--sync and --no-sync are mutually exclusive.");
+        return std::nullopt;
+    }
+    return !parser.is_set("no-sync");
+}
+
+struct ExtentStats
+{
+    size_t raw_extents = 0;
+    size_t extents = 0;
+    unsigned long long mapped_bytes = 0;
+    unsigned long long largest_run = 0;
+    double fragmentation = 0; // 0: one contiguous run, 1: every block in its own extent
+};
+
+static ExtentStats compute_stats(const ExtentMap &map, const std::vector<FileExtent> &merged)
+{
+    ExtentStats stats;
+    stats.raw_extents = map.extents.size();
+    stats.extents = merged.size();
+    for (const FileExtent &e : merged)
+    {
+        stats.mapped_bytes += e.length;
+        stats.largest_run = std::max(stats.largest_run, e.length);
+    }
+    const unsigned long long blocks = map.block_size ? (stats.mapped_bytes + map.block_size - 1) / map.block_size : 0;
+    if (stats.extents > 1 && blocks > 1)
+        stats.fragmentation = static_cast<double>(stats.extents - 1) / static_cast<double>(blocks - 1);
+    return stats;
+}
+
+static void print_extent_map(const std::string &name, const ExtentMap &map, const std::vector<FileExtent> &extents,
+                             const ExtentStats &stats, const std::string &format)
+{
+    const unsigned long long sector = map.sector_size ? map.sector_size : 512;
+    auto disk_of = [&map](const FileExtent &e)
+    { return e.disk < map.disks.size() ? map.disks[e.disk] : std::string(); };
+    if (format == "csv")
+    {
+        std::printf("logical,physical,length,absolute_lba,flags,disk\n");
+        for (const FileExtent &e : extents)
+            std::printf("%llu,%llu,%llu,%llu,0x%x,\"%s\"\n", e.logical, e.physical, e.length, e.disk_offset / sector, e.flags,
+                        quote_escape(disk_of(e), false).c_str());
+        return;
+    }
+    if (format == "json")
+    {
+        // "disk" is the first disk of the file, kept for readers of single-disk maps; extents index "disks".
+        std::string disks;
+        for (const std::string &disk : map.disks)
+            disks += (disks.empty() ? "\"" : ", \"") + quote_escape(disk, true) + "\"";
+        std::printf("{\n  \"file\": \"%s\",\n  \"disk\": \"%s\",\n  \"disks\": [%s],\n  \"size\": %llu,\n  \"sector_size\": %u,\n"
+                    "  \"block_size\": %u,\n  \"partition_start_lba\": %llu,\n  \"extents\": [",
+                    quote_escape(name, true).c_str(), map.disks.empty() ? "" : quote_escape(map.disks[0], true).c_str(),
+                    disks.c_str(), map.file_size, map.sector_size, map.block_size, map.partition_start_lba);
+        for (size_t i = 0; i < extents.size(); ++i)
+        {
+            const FileExtent &e = extents[i];
+            std::printf("%s\n    {\"logical\": %llu, \"physical\": %llu, \"length\": %llu, \"absolute_lba\": %llu, \"flags\": %u, \"disk\": %u}",
+                        i ? "," : "", e.logical, e.physical, e.length, e.disk_offset / sector, e.flags, e.disk);
+        }
+        std::printf("\n  ],\n  \"summary\": {\"raw_extents\": %zu, \"extents\": %zu, \"mapped_bytes\": %llu, "
+                    "\"largest_run\": %llu, \"fragmentation\": %.6f}\n}\n",
+                    stats.raw_extents, stats.extents, stats.mapped_bytes, stats.largest_run, stats.fragmentation);
+        return;
+    }
+
+    std::printf("File: %s\n", name.c_str());
+    // A file on several disks gets a disk column; absolute_lba is always relative to the extent's own disk.
+    const bool spanned = map.disks.size() > 1;
+    if (spanned)
+        for (size_t i = 0; i < map.disks.size(); ++i)
+            std::printf("Disk %zu: %s\n", i, map.disks[i].c_str());
+    else if (!map.disks.empty())
+        std::printf("Disk: %s\n", map.disks[0].c_str());
+    std::printf("Size: %llu bytes, block size %u, sector size %u, partition start LBA %llu\n",
+                map.file_size, map.block_size, map.sector_size, map.partition_start_lba);
+    std::printf("%6s  %18s  %18s  %16s  %14s  %s%s\n", "#", "logical", "physical", "length", "absolute_lba", spanned ? "disk  " : "", "flags");
+    for (size_t i = 0; i < extents.size(); ++i)
+    {
+        const FileExtent &e = extents[i];
+        const std::string disk = spanned ? std::to_string(e.disk) + "     " : std::string();
+        std::printf("%6zu  %#18llx  %#18llx  %16llu  %14llu  %s%s\n", i, e.logical, e.physical, e.length,
+                    e.disk_offset / sector, disk.c_str(), describe_extent_flags(e.flags).c_str());
+    }
+    std::printf("Extents: %zu (%zu before merging), mapped %llu bytes, largest contiguous run %llu bytes, fragmentation %.4f\n",
+                stats.extents, stats.raw_extents, stats.mapped_bytes, stats.largest_run, stats.fragmentation);
+}
+
+// "map" command: physical layout of one file, or a fragmentation summary for every large file
+// under a directory.
+static int run_map(int argc, char *argv[])
+{
+    ArgParser parser("Dump the physical extent map of a file, or list fragmented files in a directory.");
+    parser.add_positional("path", "File or directory to map.", true);
+    parser.add_option("--format", "-f", "output format: text, csv or json", false, "text");
+    parser.add_flag("--no-merge", "", "print extents exactly as reported by the file system");
+    parser.add_flag("--sync", "", "flush each file's dirty pages before mapping (default)");
+    parser.add_flag("--no-sync", "", "map without forcing writeback of files that are being written");
+    parser.add_option("--min-size", "-m", "directories: only report files at least this large (K/M/G/T suffix)", false, "100M");
+    parser.add_option("--log", "-L", "log level", false, "INFO");
+    parser.add_option("--metrics", "", "log FIEMAP counts and timings at exit: step or json");
+    parser.add_option("--metrics-interval", "", "seconds between metric dumps (0: only at exit)", false, "0");
+    if (!parser.parse(argc, argv))
+    {
+        return 1;
+    }
+    Logger::get().set_level(parser.get("log").value());
+    std::optional<metrics::Reporter> reporter;
+    if (auto name = parser.get("metrics"))
+    {
+        auto format = metrics::parse_format(*name);
+        auto interval = parser.get<unsigned int>("metrics-interval");
+        if (!format || !interval)
+        {
+            LOG_FATAL("--metrics takes step or json, --metrics-interval a number of seconds.");
+            return 1;
+        }
+        reporter.emplace(*format, std::chrono::seconds(*interval));
+    }
+
+    const std::string format = parser.get("format").value();
+    if (format != "text" && format != "csv" && format != "json")
+    {
+        LOG_FATAL("Unknown output format: {}", format);
         return 1;
     }
+    const bool merge = !parser.is_set("no-merge");
+    auto sync = sync_option(parser);
+    if (!sync)
+        return 1;
+    fs::path path = path_from_utf8(parser.get_positional("path").value());
 
-    fs::path filepath(argv[1]);
-#ifdef _WIN32
-    off_t offset = std::stoll(argv[2]);
-#else
-    off_t offset = std::stoll(argv[2]);
-#endif
+    std::error_code ec;
+    if (!fs::is_directory(path, ec))
+    {
+        ExtentMap map = get_extent_map(path, *sync);
+        std::vector<FileExtent> merged = merge_extents(map.extents);
+        print_extent_map(path_to_utf8(path), map, merge ? merged : map.extents, compute_stats(map, merged), format);
+        return 0;
+    }
+
+    auto min_size = parser.get_size("min-size");
+    if (!min_size)
+    {
+        LOG_FATAL("Invalid size: {}", parser.get("min-size").value());
+        return 1;
+    }
+
+    if (format == "csv")
+        std::printf("file,size,extents,raw_extents,largest_run,fragmentation\n");
+    for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (!it->is_regular_file(ec) || it->file_size(ec) < *min_size)
+            continue;
+        try
+        {
+            ExtentMap map = get_extent_map(it->path(), *sync);
+            std::vector<FileExtent> merged = merge_extents(map.extents);
+            if (merged.size() <= 1)
+                continue;
+            ExtentStats stats = compute_stats(map, merged);
+            std::string name = path_to_utf8(it->path());
+            if (format == "csv")
+                std::printf("\"%s\",%llu,%zu,%zu,%llu,%.6f\n", quote_escape(name, false).c_str(), map.file_size, stats.extents,
+                            stats.raw_extents, stats.largest_run, stats.fragmentation);
+            else if (format == "json")
+                std::printf("{\"file\": \"%s\", \"size\": %llu, \"extents\": %zu, \"raw_extents\": %zu, "
+                            "\"largest_run\": %llu, \"fragmentation\": %.6f}\n",
+                            quote_escape(name, true).c_str(), map.file_size, stats.extents, stats.raw_extents, stats.largest_run, stats.fragmentation);
+            else
+                std::printf("%s: %.2f GB, %zu extents, largest run %llu bytes, fragmentation %.4f\n", name.c_str(),
+                            static_cast<double>(map.file_size) / (1ULL << 30), stats.extents, stats.largest_run, stats.fragmentation);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARNING("Skipping {}: {}", path_to_utf8(it->path()), e.what());
+        }
+    }
+    if (ec)
+        LOG_ERROR("Error walking {}: {}", path_to_utf8(path), ec.message());
+    return 0;
+}
+
+static int run(int argc, char *argv[])
+{
+    if (argc > 1 && std::string_view(argv[1]) == "map")
+    {
+        try
+        {
+            return run_map(argc - 1, argv + 1);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_FATAL("Failed to map extents: {}", e.what());
+            return 1;
+        }
+    }
+
+    ArgParser parser("Translate file offsets to disk LBAs. ver. 0.2.0\n"
+                     "Use '" + std::string(argv[0]) + " map <path>' to dump a file's extent map.");
+    parser.add_positional("file_path", "File whose offsets are translated.", true);
+    parser.add_option("--input", "-i", "read offsets (one per line) from a file, '-' for stdin");
+    parser.add_option("--format", "-f", "batch output format: csv or json [default: csv]");
+    parser.add_flag("--sync", "", "flush the file's dirty pages before mapping (default)");
+    parser.add_flag("--no-sync", "", "map without forcing writeback of a file that is being written");
+    parser.add_option("--log", "-L", "log level", false, "INFO");
+    parser.add_option("--metrics", "", "log FIEMAP counts and timings at exit: step or json");
+    parser.add_option("--metrics-interval", "", "seconds between metric dumps (0: only at exit)", false, "0");
+    if (!parser.parse(argc, argv))
+    {
+        return 1;
+    }
+    Logger::get().set_level(parser.get("log").value());
+    std::optional<metrics::Reporter> reporter;
+    if (auto name = parser.get("metrics"))
+    {
+        auto format = metrics::parse_format(*name);
+        auto interval = parser.get<unsigned int>("metrics-interval");
+        if (!format || !interval)
+        {
+            LOG_FATAL("--metrics takes step or json, --metrics-interval a number of seconds.");
+            return 1;
+        }
+        reporter.emplace(*format, std::chrono::seconds(*interval));
+    }
+
+    fs::path filepath = path_from_utf8(parser.get_positional("file_path").value());
+
+    std::vector<unsigned long long> offsets;
+    for (const auto &arg : parser.positional())
+    {
+        auto offset = parse_integer<unsigned long long>(arg);
+        if (!offset)
+        {
+            LOG_FATAL("Invalid offset: {}", arg);
+            return 1;
+        }
+        offsets.push_back(*offset);
+    }
+    if (auto input = parser.get("input"))
+    {
+        bool ok;
+        if (*input == "-")
+        {
+            ok = read_offsets(std::cin, offsets);
+        }
+        else
+        {
+            std::ifstream is(path_from_utf8(*input));
+            if (!is)
+            {
+                LOG_FATAL("Failed to open offset list: {}", *input);
+                return 1;
+            }
+            ok = read_offsets(is, offsets);
+        }
+        if (!ok)
+            return 1;
+    }
+
+    std::string format = parser.get("format").value_or("");
+    if (!format.empty() && format != "csv" && format != "json")
+    {
+        LOG_FATAL("Unknown output format: {}", format);
+        return 1;
+    }
+    if (offsets.empty())
+    {
+        LOG_FATAL("No offsets given.");
+        return 1;
+    }
+    auto sync = sync_option(parser);
+    if (!sync)
+        return 1;
 
     try
     {
-        get_lba(filepath, offset);
+        // A single offset without an explicit format keeps the human-readable report.
+        if (offsets.size() == 1 && format.empty() && !parser.is_set("input"))
+        {
+            get_lba(filepath, static_cast<off_t>(offsets.front()), *sync);
+        }
+        else
+        {
+            ResultWriter writer(format == "json");
+            get_lba_batch(filepath, offsets, std::ref(writer), *sync);
+        }
     }
     catch (const std::system_error &e)
     {
@@ -62,3 +428,22 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t *argv[])
+{
+    std::vector<std::string> args;
+    for (int i = 0; i < argc; ++i)
+        args.push_back(to_string(argv[i]));
+    std::vector<char *> argv_utf8;
+    for (auto &arg : args)
+        argv_utf8.push_back(arg.data());
+    argv_utf8.push_back(nullptr);
+    return run(argc, argv_utf8.data());
+}
+#else
+int main(int argc, char *argv[])
+{
+    return run(argc, argv);
+}
+#endif
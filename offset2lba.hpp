@@ -3,17 +3,65 @@
 
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <vector>
 #include <sys/types.h>
 
 namespace fs = std::filesystem;
 
-#ifdef _WIN32
-using os_string_t = std::wstring;
-#else
-using os_string_t = std::string;
-#endif
-
 // Calculates the LBA for a given file path and offset.
-void get_lba(fs::path &filepath, off_t offset);
+// sync flushes the file's dirty pages first (FIEMAP_FLAG_SYNC on Linux) so that delayed
+// allocations get their final location; without it a lookup never triggers writeback.
+void get_lba(fs::path &filepath, off_t offset, bool sync = true);
+
+// Translation of one file offset, as produced by get_lba_batch().
+struct LbaResult
+{
+    unsigned long long offset = 0;
+    bool mapped = false;                     // false for holes and offsets past the end of the file
+    unsigned long long physical_offset = 0;  // byte offset from the start of the partition/volume
+    unsigned long long fs_lba = 0;           // physical_offset / sector_size
+    unsigned long long absolute_lba = 0;     // LBA on the whole disk
+    unsigned int sector_size = 0;            // logical block size of the disk
+    unsigned int flags = 0;                  // platform extent flags (FIEMAP_EXTENT_* on Linux)
+    std::string disk;                        // whole-disk device absolute_lba refers to, if known
+};
+
+// One mapped range of a file, in bytes. physical is relative to the start of the partition/volume.
+// A range that crosses from one disk of a spanned or striped volume to another is split there.
+struct FileExtent
+{
+    unsigned long long logical = 0;
+    unsigned long long physical = 0;
+    unsigned long long length = 0;
+    unsigned int flags = 0;               // platform extent flags (FIEMAP_EXTENT_* on Linux)
+    unsigned int disk = 0;                // index into ExtentMap::disks
+    unsigned long long disk_offset = 0;   // bytes from the start of that disk
+};
+
+// Physical layout of a whole file.
+struct ExtentMap
+{
+    unsigned long long file_size = 0;
+    unsigned int sector_size = 0;
+    unsigned int block_size = 0; // file system block / cluster size
+    unsigned long long partition_start_lba = 0; // of the first disk extent of the volume
+    std::vector<std::string> disks;  // whole-disk devices holding the file, if known
+    std::vector<FileExtent> extents; // in logical order, as reported by the file system
+};
+
+// Retrieves every extent of a file in one pass.
+ExtentMap get_extent_map(const fs::path &filepath, bool sync = true);
+
+// Joins extents that are contiguous logically, physically and on their disk and carry the same flags.
+std::vector<FileExtent> merge_extents(const std::vector<FileExtent> &extents);
+
+// Human-readable names of the platform extent flags, e.g. "last,unwritten".
+std::string describe_extent_flags(unsigned int flags);
+
+// Translates many offsets of one file. The file's extent list and the partition start are
+// looked up once; offsets are sorted in place and results are passed to sink in that order.
+void get_lba_batch(const fs::path &filepath, std::vector<unsigned long long> &offsets,
+                   const std::function<void(const LbaResult &)> &sink, bool sync = true);
 
 #endif // OFFSET2LBA_HPP
@@ -1,5 +1,7 @@
 #include "offset2lba.hpp"
+#include "blockio.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
 
 #ifndef _WIN32
 
@@ -14,44 +16,148 @@
 #include <sys/stat.h>
 #include <string>
 #include <utility>
-#include <fstream>
-#include <dirent.h>
 #include <sys/sysmacros.h>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
-// RAII wrapper for file descriptor to ensure it's closed.
-struct FileDescriptor
+constexpr int DEFAULT_SECTOR_SIZE = 512;
+
+// Where a block device sits on its disk, as described by sysfs.
+struct BlockDeviceInfo
+{
+    bool found = false;
+    std::string name;                       // kernel name of the device, e.g. "nvme0n1p2"
+    std::string disk;                       // whole-disk parent, e.g. "nvme0n1" (same as name for a whole disk)
+    dev_t disk_dev = 0;
+    unsigned long long partition_start = 0; // bytes from the start of the disk
+    unsigned int logical_block_size = DEFAULT_SECTOR_SIZE;
+
+    unsigned long long partition_start_lba() const { return partition_start / logical_block_size; }
+};
+
+// Resolves each dev_t once through /sys/dev/block/MAJ:MIN and keeps the result for later lookups.
+class DeviceTopologyCache
 {
-    int fd;
-    FileDescriptor(const char *path, int flags) : fd(open(path, flags)) {}
-    ~FileDescriptor()
+public:
+    static DeviceTopologyCache &get()
+    {
+        static DeviceTopologyCache instance;
+        return instance;
+    }
+
+    const BlockDeviceInfo &lookup(dev_t dev)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(dev);
+        if (it == cache_.end())
+            it = cache_.emplace(dev, resolve(dev)).first;
+        return it->second;
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<dev_t, BlockDeviceInfo> cache_;
+
+    // Reads a small sysfs attribute such as "2048\n" or "259:3\n".
+    static std::optional<std::string> read_attr(const fs::path &path)
+    {
+        blockio::Handle fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd.valid())
+            return std::nullopt;
+        char buf[64];
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        if (n <= 0)
+            return std::nullopt;
+        std::string value(buf, static_cast<size_t>(n));
+        while (!value.empty() && (value.back() == '\n' || value.back() == ' '))
+            value.pop_back();
+        return value;
+    }
+
+    static std::optional<unsigned long long> read_number(const fs::path &path)
     {
-        if (fd >= 0)
-            close(fd);
+        auto value = read_attr(path);
+        if (!value)
+            return std::nullopt;
+        try
+        {
+            return std::stoull(*value);
+        }
+        catch (...)
+        {
+            return std::nullopt;
+        }
     }
 
-    FileDescriptor(const FileDescriptor &) = delete;
-    FileDescriptor &operator=(const FileDescriptor &) = delete;
+    static BlockDeviceInfo resolve(dev_t dev)
+    {
+        BlockDeviceInfo info;
+        const std::string sys_path = "/sys/dev/block/" + std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+        std::error_code ec;
+        fs::path dev_dir = fs::canonical(sys_path, ec);
+        if (ec)
+        {
+            LOG_WARNING("No sysfs entry for block device {}:{}; assuming a whole disk with {}-byte sectors.",
+                        major(dev), minor(dev), DEFAULT_SECTOR_SIZE);
+            return info;
+        }
 
-    operator int() const { return fd; }
+        info.found = true;
+        info.name = dev_dir.filename().string();
+        info.disk_dev = dev;
+        fs::path disk_dir = dev_dir;
+        if (fs::exists(dev_dir / "partition", ec))
+        {
+            disk_dir = dev_dir.parent_path();
+            // sysfs reports the partition start in 512-byte units regardless of the disk's block size.
+            info.partition_start = read_number(dev_dir / "start").value_or(0) * 512;
+            unsigned int disk_major, disk_minor;
+            char colon;
+            if (auto dev_attr = read_attr(disk_dir / "dev"); dev_attr && std::sscanf(dev_attr->c_str(), "%u%c%u", &disk_major, &colon, &disk_minor) == 3)
+                info.disk_dev = makedev(disk_major, disk_minor);
+        }
+        info.disk = disk_dir.filename().string();
+        if (auto lbs = read_number(disk_dir / "queue" / "logical_block_size"); lbs && *lbs > 0)
+            info.logical_block_size = static_cast<unsigned int>(*lbs);
+        return info;
+    }
 };
 
-constexpr int DEFAULT_SECTOR_SIZE = 512;
 
-std::pair<std::vector<char>, struct stat> get_fiemap_data(const char *filepath, off_t offset);
+std::pair<std::vector<char>, struct stat> get_fiemap_data(const char *filepath, off_t offset, bool sync);
 void calculate_and_print_lba(const struct fiemap *fiemap_data, const struct stat &st, const char *filepath, off_t offset);
+std::vector<FileExtent> get_file_extents(int fd, bool sync);
+
+// Delayed-allocation extents have no physical location yet, and unwritten (preallocated)
+// extents read back as zeros; both make the reported LBAs unreliable for a live file.
+void warn_unsettled_extents(unsigned int delalloc, unsigned int unwritten, bool sync)
+{
+    if (delalloc > 0)
+    {
+        LOG_WARNING("{} extent(s) use delayed allocation and have no physical location yet{}", delalloc,
+                    sync ? "." : "; run with --sync to flush them first.");
+    }
+    if (unwritten > 0)
+    {
+        LOG_WARNING("{} extent(s) are allocated but unwritten; reading their LBAs returns zeros, not file data.", unwritten);
+    }
+}
 
-void get_lba(fs::path &filepath, off_t offset)
+void get_lba(fs::path &filepath, off_t offset, bool sync)
 {
-    auto [fiemap_buffer, st] = get_fiemap_data(filepath.generic_string().c_str(), offset);
+    auto [fiemap_buffer, st] = get_fiemap_data(filepath.generic_string().c_str(), offset, sync);
     const struct fiemap *fiemap_data = reinterpret_cast<const struct fiemap *>(fiemap_buffer.data());
     calculate_and_print_lba(fiemap_data, st, filepath.generic_string().c_str(), offset);
 }
 
 // Gets fiemap data for a given offset.
-std::pair<std::vector<char>, struct stat> get_fiemap_data(const char *filepath, off_t offset)
+std::pair<std::vector<char>, struct stat> get_fiemap_data(const char *filepath, off_t offset, bool sync)
 {
-    FileDescriptor fd(filepath, O_RDONLY);
-    if (fd < 0)
+    blockio::Handle fd(open(filepath, O_RDONLY | O_CLOEXEC));
+    if (!fd.valid())
     {
         throw std::system_error(errno, std::generic_category(), "Failed to open file");
     }
@@ -69,61 +175,223 @@ std::pair<std::vector<char>, struct stat> get_fiemap_data(const char *filepath,
 
     fiemap_data->fm_start = offset;
     fiemap_data->fm_length = 1;
-    fiemap_data->fm_flags = FIEMAP_FLAG_SYNC;
+    fiemap_data->fm_flags = sync ? FIEMAP_FLAG_SYNC : 0;
     fiemap_data->fm_extent_count = max_extents;
 
+    METRIC_INC("offset2lba.fiemap");
     if (ioctl(fd, FS_IOC_FIEMAP, fiemap_data) < 0)
     {
         throw std::system_error(errno, std::generic_category(), "ioctl(FS_IOC_FIEMAP) failed");
     }
 
+    unsigned int delalloc = 0, unwritten = 0;
+    for (unsigned int i = 0; i < fiemap_data->fm_mapped_extents; ++i)
+    {
+        delalloc += (fiemap_data->fm_extents[i].fe_flags & FIEMAP_EXTENT_DELALLOC) != 0;
+        unwritten += (fiemap_data->fm_extents[i].fe_flags & FIEMAP_EXTENT_UNWRITTEN) != 0;
+    }
+    warn_unsettled_extents(delalloc, unwritten, sync);
+
     return {std::move(fiemap_buffer), st};
 }
 
-// Finds the partition start sector by searching /sys/class/block.
-long long get_partition_start_sector(dev_t dev_id)
+// Reads the complete extent list of an open file. A first call with fm_extent_count = 0 sizes
+// the buffer; if the file grew extents meanwhile, the buffer is doubled for the next page.
+std::vector<FileExtent> get_file_extents(int fd, bool sync)
 {
-    const std::string sys_block_path = "/sys/class/block/";
-    DIR *dir = opendir(sys_block_path.c_str());
-    if (!dir)
+    constexpr unsigned int min_extents_per_call = 32;
+    constexpr unsigned int max_extents_per_call = 65536;
+
+    struct fiemap probe = {};
+    probe.fm_start = 0;
+    probe.fm_length = FIEMAP_MAX_OFFSET;
+    probe.fm_flags = sync ? FIEMAP_FLAG_SYNC : 0; // dirty pages are flushed once, by this call
+    probe.fm_extent_count = 0;
+    METRIC_INC("offset2lba.fiemap");
+    if (ioctl(fd, FS_IOC_FIEMAP, &probe) < 0)
     {
-        LOG_WARNING("Could not open /sys/class/block to find partition start.");
-        return 0;
+        throw std::system_error(errno, std::generic_category(), "ioctl(FS_IOC_FIEMAP) failed");
     }
 
-    long long partition_start = 0;
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != nullptr)
+    std::vector<FileExtent> extents;
+    if (probe.fm_mapped_extents == 0)
+        return extents;
+    extents.reserve(probe.fm_mapped_extents);
+
+    unsigned int extents_per_call = std::clamp(probe.fm_mapped_extents + 1, min_extents_per_call, max_extents_per_call);
+    std::vector<char> fiemap_buffer;
+    unsigned long long start = 0;
+    for (;;)
     {
-        std::string dev_name = entry->d_name;
-        if (dev_name == "." || dev_name == "..")
+        fiemap_buffer.assign(sizeof(struct fiemap) + extents_per_call * sizeof(struct fiemap_extent), 0);
+        struct fiemap *fiemap_data = reinterpret_cast<struct fiemap *>(fiemap_buffer.data());
+        fiemap_data->fm_start = start;
+        fiemap_data->fm_length = FIEMAP_MAX_OFFSET - start;
+        fiemap_data->fm_flags = 0;
+        fiemap_data->fm_extent_count = extents_per_call;
+
+        METRIC_INC("offset2lba.fiemap");
+        if (ioctl(fd, FS_IOC_FIEMAP, fiemap_data) < 0)
         {
-            continue;
+            throw std::system_error(errno, std::generic_category(), "ioctl(FS_IOC_FIEMAP) failed");
         }
+        if (fiemap_data->fm_mapped_extents == 0)
+            break;
 
-        std::string dev_path = sys_block_path + dev_name + "/dev";
-        std::ifstream dev_file(dev_path);
-        if (dev_file.is_open())
+        bool last = false;
+        for (unsigned int i = 0; i < fiemap_data->fm_mapped_extents; ++i)
         {
-            unsigned int dev_major, dev_minor;
-            char colon;
-            dev_file >> dev_major >> colon >> dev_minor;
+            const struct fiemap_extent &e = fiemap_data->fm_extents[i];
+            extents.push_back({e.fe_logical, e.fe_physical, e.fe_length, e.fe_flags});
+            last = (e.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+        }
+        if (last)
+            break;
+        start = extents.back().logical + extents.back().length;
+        extents_per_call = std::min(extents_per_call * 2, max_extents_per_call);
+    }
+
+    unsigned int delalloc = 0, unwritten = 0;
+    for (const FileExtent &e : extents)
+    {
+        delalloc += (e.flags & FIEMAP_EXTENT_DELALLOC) != 0;
+        unwritten += (e.flags & FIEMAP_EXTENT_UNWRITTEN) != 0;
+    }
+    warn_unsettled_extents(delalloc, unwritten, sync);
+    return extents;
+}
+
+ExtentMap get_extent_map(const fs::path &filepath, bool sync)
+{
+    METRIC_TIMER("offset2lba.extent_map_ns");
+    blockio::Handle fd(open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid())
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to open file");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to get file stats");
+    }
+
+    const BlockDeviceInfo &device = DeviceTopologyCache::get().lookup(st.st_dev);
+
+    ExtentMap map;
+    map.file_size = static_cast<unsigned long long>(st.st_size);
+    map.sector_size = device.logical_block_size;
+    map.block_size = static_cast<unsigned int>(st.st_blksize);
+    map.partition_start_lba = device.partition_start_lba();
+    if (device.found)
+        map.disks.push_back("/dev/" + device.disk);
+    map.extents = get_file_extents(fd, sync);
+    for (FileExtent &e : map.extents)
+        e.disk_offset = device.partition_start + e.physical;
+    return map;
+}
 
-            if (makedev(dev_major, dev_minor) == dev_id)
+std::vector<FileExtent> merge_extents(const std::vector<FileExtent> &extents)
+{
+    std::vector<FileExtent> merged;
+    merged.reserve(extents.size());
+    for (const FileExtent &e : extents)
+    {
+        if (!merged.empty())
+        {
+            FileExtent &prev = merged.back();
+            const unsigned int prev_flags = prev.flags & ~FIEMAP_EXTENT_LAST;
+            const unsigned int flags = e.flags & ~FIEMAP_EXTENT_LAST;
+            if (prev.logical + prev.length == e.logical && prev.physical + prev.length == e.physical && prev.disk == e.disk &&
+                prev.disk_offset + prev.length == e.disk_offset && prev_flags == flags && !(flags & FIEMAP_EXTENT_UNKNOWN))
             {
-                std::string start_path = sys_block_path + dev_name + "/start";
-                std::ifstream start_file(start_path);
-                if (start_file.is_open())
-                {
-                    start_file >> partition_start;
-                }
-                break; // Found device
+                prev.length += e.length;
+                prev.flags |= e.flags & FIEMAP_EXTENT_LAST;
+                continue;
             }
         }
+        merged.push_back(e);
     }
+    return merged;
+}
 
-    closedir(dir);
-    return partition_start;
+std::string describe_extent_flags(unsigned int flags)
+{
+    static const std::pair<unsigned int, const char *> names[] = {
+        {FIEMAP_EXTENT_LAST, "last"},
+        {FIEMAP_EXTENT_UNKNOWN, "unknown"},
+        {FIEMAP_EXTENT_DELALLOC, "delalloc"},
+        {FIEMAP_EXTENT_ENCODED, "encoded"},
+        {FIEMAP_EXTENT_DATA_ENCRYPTED, "encrypted"},
+        {FIEMAP_EXTENT_NOT_ALIGNED, "not_aligned"},
+        {FIEMAP_EXTENT_DATA_INLINE, "inline"},
+        {FIEMAP_EXTENT_DATA_TAIL, "tail"},
+        {FIEMAP_EXTENT_UNWRITTEN, "unwritten"},
+        {FIEMAP_EXTENT_MERGED, "merged"},
+        {FIEMAP_EXTENT_SHARED, "shared"},
+    };
+    std::string text;
+    for (const auto &[bit, name] : names)
+    {
+        if (flags & bit)
+        {
+            if (!text.empty())
+                text += ',';
+            text += name;
+        }
+    }
+    return text;
+}
+
+void get_lba_batch(const fs::path &filepath, std::vector<unsigned long long> &offsets,
+                   const std::function<void(const LbaResult &)> &sink, bool sync)
+{
+    METRIC_TIMER("offset2lba.batch_ns");
+    METRIC_ADD("offset2lba.offsets", offsets.size());
+    blockio::Handle fd(open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid())
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to open file");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Failed to get file stats");
+    }
+
+    const std::vector<FileExtent> extents = get_file_extents(fd, sync);
+    const BlockDeviceInfo &device = DeviceTopologyCache::get().lookup(st.st_dev);
+
+    std::sort(offsets.begin(), offsets.end());
+
+    // Offsets are sorted, so each search starts at the extent that held the previous one.
+    auto lo = extents.begin();
+    for (unsigned long long offset : offsets)
+    {
+        LbaResult result;
+        result.offset = offset;
+        result.sector_size = device.logical_block_size;
+        if (device.found)
+            result.disk = "/dev/" + device.disk;
+
+        auto next = std::upper_bound(lo, extents.end(), offset, [](unsigned long long v, const FileExtent &e)
+                                     { return v < e.logical; });
+        if (next != extents.begin())
+        {
+            lo = std::prev(next);
+            if (offset < lo->logical + lo->length)
+                result.flags = lo->flags;
+            if (offset < lo->logical + lo->length && !(lo->flags & FIEMAP_EXTENT_UNKNOWN))
+            {
+                result.mapped = true;
+                result.physical_offset = lo->physical + (offset - lo->logical);
+                result.fs_lba = result.physical_offset / device.logical_block_size;
+                result.absolute_lba = (device.partition_start + result.physical_offset) / device.logical_block_size;
+            }
+        }
+        sink(result);
+    }
 }
 
 // Calculates LBA from fiemap data and prints the results.
@@ -137,15 +405,19 @@ void calculate_and_print_lba(const struct fiemap *fiemap_data, const struct stat
 
     const struct fiemap_extent *extent = &fiemap_data->fm_extents[0];
     unsigned long long physical_block_address_bytes = extent->fe_physical + (static_cast<unsigned long long>(offset) - extent->fe_logical);
-    unsigned long long fs_lba = physical_block_address_bytes / DEFAULT_SECTOR_SIZE;
+    const BlockDeviceInfo &device = DeviceTopologyCache::get().lookup(st.st_dev);
+    unsigned long long fs_lba = physical_block_address_bytes / device.logical_block_size;
 
-    long long partition_start_lba = get_partition_start_sector(st.st_dev);
-    unsigned long long absolute_lba = fs_lba + partition_start_lba;
+    unsigned long long partition_start_lba = device.partition_start_lba();
+    unsigned long long absolute_lba = (device.partition_start + physical_block_address_bytes) / device.logical_block_size;
 
     LOG_INFO("File: {}", filepath);
     LOG_INFO("Offset: {}", offset);
     LOG_INFO("----------------------------------------");
+    if (device.found)
+        LOG_INFO("Device: /dev/{} on disk /dev/{}", device.name, device.disk);
     LOG_INFO("File System Block Size: {} bytes", st.st_blksize);
+    LOG_INFO("Disk Logical Block Size: {} bytes", device.logical_block_size);
     LOG_INFO("Physical Block Address: {} (bytes)", physical_block_address_bytes);
     LOG_INFO("LBA (relative to filesystem): {}", fs_lba);
     LOG_INFO("Partition Start LBA:          {}", partition_start_lba);
@@ -1,5 +1,7 @@
 #include "offset2lba.hpp"
+#include "blockio.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
 
 #ifdef _WIN32
 
@@ -10,25 +12,23 @@
 #include <system_error>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
-// RAII wrapper for HANDLE
-struct HandleWrapper
+// Where a volume byte offset lives on a physical drive.
+struct DiskLocation
 {
-    HANDLE handle = INVALID_HANDLE_VALUE;
-    HandleWrapper(HANDLE h) : handle(h) {}
-    ~HandleWrapper()
-    {
-        if (handle != INVALID_HANDLE_VALUE)
-        {
-            CloseHandle(handle);
-        }
-    }
-
-    // Prevent copying
-    HandleWrapper(const HandleWrapper &) = delete;
-    HandleWrapper &operator=(const HandleWrapper &) = delete;
+    DWORD DiskNumber;
+    LONGLONG Offset; // bytes from the start of the disk
+};
 
-    operator HANDLE() const { return handle; }
+// A volume range that is contiguous on one disk.
+struct DiskPiece
+{
+    LONGLONG VolumeOffset;
+    LONGLONG Length;
+    DiskLocation Location;
 };
 
 // Struct to hold disk/volume information
@@ -36,22 +36,39 @@ struct VolumeInfo
 {
     DWORD ClusterSize;
     DWORD BytesPerSector;
-    LARGE_INTEGER PartitionStartOffset;
+    LARGE_INTEGER PartitionStartOffset;  // start of the first disk extent
+    std::vector<DISK_EXTENT> Extents;    // in volume order; more than one for spanned/striped volumes
+    std::shared_ptr<blockio::Handle> Volume; // kept open for IOCTL_VOLUME_LOGICAL_TO_PHYSICAL
+
+    DiskLocation ToDisk(LONGLONG volumeOffset) const;
+    // Splits a volume range wherever it moves to another disk extent or stripe.
+    std::vector<DiskPiece> ToDiskPieces(LONGLONG volumeOffset, LONGLONG length) const;
+};
+
+// A run of clusters: VCNs [Vcn, NextVcn) are stored from Lcn on (Lcn == -1 for sparse ranges).
+struct ClusterRun
+{
+    LONGLONG Vcn;
+    LONGLONG NextVcn;
+    LONGLONG Lcn;
 };
 
 // Forward declarations
-VolumeInfo GetVolumeInfo(fs::path &filepath);
+const VolumeInfo &GetVolumeInfo(const fs::path &filepath);
 LARGE_INTEGER FindLcnFromVcn(HANDLE hFile, LONGLONG vcn);
+std::vector<ClusterRun> GetClusterRuns(HANDLE hFile);
+std::string PhysicalDriveName(DWORD diskNumber);
 void CalculateAndPrintLbaInfo(fs::path &filepath, off_t offset, const VolumeInfo &volInfo, LARGE_INTEGER lcn);
 
-void get_lba(fs::path &filepath, off_t offset)
+// NTFS retrieval pointers do not depend on dirty data being flushed, so sync has no effect here.
+void get_lba(fs::path &filepath, off_t offset, bool /*sync*/)
 {
     try
     {
         // 1. Get file handle and check offset
         std::wstring widePath = filepath.generic_wstring();
-        HandleWrapper fileHandle(CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
-        if (fileHandle.handle == INVALID_HANDLE_VALUE)
+        blockio::Handle fileHandle(CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
+        if (!fileHandle.valid())
         {
             throw std::system_error(GetLastError(), std::system_category(), "Failed to open file");
         }
@@ -67,7 +84,7 @@ void get_lba(fs::path &filepath, off_t offset)
         }
 
         // 2. Gather all disk and volume information
-        VolumeInfo volInfo = GetVolumeInfo(filepath);
+        const VolumeInfo &volInfo = GetVolumeInfo(filepath);
 
         // 3. Find the Logical Cluster Number (LCN) for the given offset
         LONGLONG vcn = offset / volInfo.ClusterSize;
@@ -88,41 +105,339 @@ void get_lba(fs::path &filepath, off_t offset)
     }
 }
 
-VolumeInfo GetVolumeInfo(fs::path &filepath)
+void get_lba_batch(const fs::path &filepath, std::vector<unsigned long long> &offsets,
+                   const std::function<void(const LbaResult &)> &sink, bool /*sync*/)
 {
-    std::wstring volumePathW(MAX_PATH, L'\0');
-    if (!GetVolumePathNameW(filepath.c_str(), volumePathW.data(), static_cast<DWORD>(volumePathW.size())))
+    METRIC_TIMER("offset2lba.batch_ns");
+    METRIC_ADD("offset2lba.offsets", offsets.size());
+    std::wstring widePath = filepath.generic_wstring();
+    blockio::Handle fileHandle(CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
+    if (!fileHandle.valid())
+    {
+        throw std::system_error(GetLastError(), std::system_category(), "Failed to open file");
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        throw std::system_error(GetLastError(), std::system_category(), "Failed to get file size");
+    }
+
+    const VolumeInfo &volInfo = GetVolumeInfo(filepath);
+    const std::vector<ClusterRun> runs = GetClusterRuns(fileHandle);
+
+    std::sort(offsets.begin(), offsets.end());
+
+    // Offsets are sorted, so each search starts at the run that held the previous one.
+    auto lo = runs.begin();
+    for (unsigned long long offset : offsets)
+    {
+        LbaResult result;
+        result.offset = offset;
+        result.sector_size = volInfo.BytesPerSector;
+        if (offset < static_cast<unsigned long long>(fileSize.QuadPart))
+        {
+            const LONGLONG vcn = static_cast<LONGLONG>(offset / volInfo.ClusterSize);
+            lo = std::upper_bound(lo, runs.end(), vcn, [](LONGLONG v, const ClusterRun &run)
+                                  { return v < run.NextVcn; });
+            if (lo != runs.end() && vcn >= lo->Vcn && lo->Lcn != -1)
+            {
+                const LONGLONG lcn = lo->Lcn + (vcn - lo->Vcn);
+                result.mapped = true;
+                result.physical_offset = static_cast<unsigned long long>(lcn) * volInfo.ClusterSize + offset % volInfo.ClusterSize;
+                result.fs_lba = result.physical_offset / volInfo.BytesPerSector;
+                const DiskLocation location = volInfo.ToDisk(static_cast<LONGLONG>(result.physical_offset));
+                result.absolute_lba = location.Offset / volInfo.BytesPerSector;
+                result.disk = PhysicalDriveName(location.DiskNumber);
+            }
+        }
+        sink(result);
+    }
+}
+
+ExtentMap get_extent_map(const fs::path &filepath, bool /*sync*/)
+{
+    METRIC_TIMER("offset2lba.extent_map_ns");
+    std::wstring widePath = filepath.generic_wstring();
+    blockio::Handle fileHandle(CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
+    if (!fileHandle.valid())
+    {
+        throw std::system_error(GetLastError(), std::system_category(), "Failed to open file");
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
     {
-        throw std::system_error(GetLastError(), std::system_category(), "Failed to get volume path name");
+        throw std::system_error(GetLastError(), std::system_category(), "Failed to get file size");
+    }
+
+    const VolumeInfo &volInfo = GetVolumeInfo(filepath);
+
+    ExtentMap map;
+    map.file_size = static_cast<unsigned long long>(fileSize.QuadPart);
+    map.sector_size = volInfo.BytesPerSector;
+    map.block_size = volInfo.ClusterSize;
+    map.partition_start_lba = volInfo.PartitionStartOffset.QuadPart / volInfo.BytesPerSector;
+    auto diskIndex = [&map](DWORD diskNumber)
+    {
+        const std::string name = PhysicalDriveName(diskNumber);
+        auto it = std::find(map.disks.begin(), map.disks.end(), name);
+        if (it == map.disks.end())
+            it = map.disks.insert(it, name);
+        return static_cast<unsigned int>(it - map.disks.begin());
+    };
+    if (volInfo.Extents.size() == 1)
+        diskIndex(volInfo.Extents[0].DiskNumber);
+    for (const ClusterRun &run : GetClusterRuns(fileHandle))
+    {
+        if (run.Lcn == -1)
+            continue; // sparse range, nothing on disk
+        const unsigned long long logical = static_cast<unsigned long long>(run.Vcn) * volInfo.ClusterSize;
+        const LONGLONG physical = run.Lcn * volInfo.ClusterSize;
+        for (const DiskPiece &piece : volInfo.ToDiskPieces(physical, (run.NextVcn - run.Vcn) * volInfo.ClusterSize))
+        {
+            map.extents.push_back({logical + static_cast<unsigned long long>(piece.VolumeOffset - physical),
+                                   static_cast<unsigned long long>(piece.VolumeOffset),
+                                   static_cast<unsigned long long>(piece.Length),
+                                   0,
+                                   diskIndex(piece.Location.DiskNumber),
+                                   static_cast<unsigned long long>(piece.Location.Offset)});
+        }
+    }
+    return map;
+}
+
+std::vector<FileExtent> merge_extents(const std::vector<FileExtent> &extents)
+{
+    std::vector<FileExtent> merged;
+    for (const FileExtent &e : extents)
+    {
+        if (!merged.empty() && merged.back().logical + merged.back().length == e.logical &&
+            merged.back().physical + merged.back().length == e.physical && merged.back().disk == e.disk &&
+            merged.back().disk_offset + merged.back().length == e.disk_offset && merged.back().flags == e.flags)
+        {
+            merged.back().length += e.length;
+            continue;
+        }
+        merged.push_back(e);
+    }
+    return merged;
+}
+
+std::string describe_extent_flags(unsigned int)
+{
+    return {};
+}
+
+// Probes a volume once; later lookups for files on the same volume reuse the result.
+class VolumeCache
+{
+public:
+    static VolumeCache &get()
+    {
+        static VolumeCache instance;
+        return instance;
+    }
+
+    const VolumeInfo &lookup(const fs::path &filepath)
+    {
+        std::wstring volumePathW(MAX_PATH, L'\0');
+        if (!GetVolumePathNameW(filepath.c_str(), volumePathW.data(), static_cast<DWORD>(volumePathW.size())))
+        {
+            throw std::system_error(GetLastError(), std::system_category(), "Failed to get volume path name");
+        }
+        volumePathW.resize(wcsnlen_s(volumePathW.data(), MAX_PATH));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(volumePathW);
+        if (it == cache_.end())
+            it = cache_.emplace(volumePathW, resolve(volumePathW)).first;
+        return it->second;
     }
 
-    volumePathW.resize(wcsnlen_s(volumePathW.data(), MAX_PATH));
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::wstring, VolumeInfo> cache_;
 
-    DWORD sectorsPerCluster, bytesPerSector, numberOfFreeClusters, totalNumberOfClusters;
-    if (!GetDiskFreeSpaceW(volumePathW.c_str(), &sectorsPerCluster, &bytesPerSector, &numberOfFreeClusters, &totalNumberOfClusters))
+    static VolumeInfo resolve(const std::wstring &volumePathW)
     {
-        throw std::system_error(GetLastError(), std::system_category(), "Failed to get disk free space");
+        DWORD sectorsPerCluster, bytesPerSector, numberOfFreeClusters, totalNumberOfClusters;
+        if (!GetDiskFreeSpaceW(volumePathW.c_str(), &sectorsPerCluster, &bytesPerSector, &numberOfFreeClusters, &totalNumberOfClusters))
+        {
+            throw std::system_error(GetLastError(), std::system_category(), "Failed to get disk free space");
+        }
+
+        // GetVolumeNameForVolumeMountPointW also covers folder mount points, not just drive letters.
+        std::wstring volumeDevicePathW(MAX_PATH, L'\0');
+        if (GetVolumeNameForVolumeMountPointW(volumePathW.c_str(), volumeDevicePathW.data(), static_cast<DWORD>(volumeDevicePathW.size())))
+        {
+            volumeDevicePathW.resize(wcsnlen_s(volumeDevicePathW.data(), MAX_PATH));
+            if (!volumeDevicePathW.empty() && volumeDevicePathW.back() == L'\\')
+                volumeDevicePathW.pop_back(); // \\?\Volume{GUID}
+        }
+        else
+        {
+            volumeDevicePathW = L"\\\\.\\";
+            volumeDevicePathW += volumePathW.substr(0, 2); // \\.\<drive>:
+        }
+        auto volumeHandle = std::make_shared<blockio::Handle>(CreateFileW(volumeDevicePathW.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
+        if (!volumeHandle->valid())
+        {
+            throw std::system_error(GetLastError(), std::system_category(), "Failed to open volume");
+        }
+
+        // Start with room for a few extents and grow to the count the driver reports.
+        std::vector<char> buffer(sizeof(VOLUME_DISK_EXTENTS) + 3 * sizeof(DISK_EXTENT));
+        VOLUME_DISK_EXTENTS *diskExtents = nullptr;
+        for (;;)
+        {
+            diskExtents = reinterpret_cast<VOLUME_DISK_EXTENTS *>(buffer.data());
+            DWORD bytesReturned;
+            if (DeviceIoControl(*volumeHandle, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0, diskExtents, static_cast<DWORD>(buffer.size()), &bytesReturned, NULL))
+                break;
+            DWORD error = GetLastError();
+            if (error != ERROR_MORE_DATA || diskExtents->NumberOfDiskExtents == 0)
+            {
+                throw std::system_error(error, std::system_category(), "IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS failed");
+            }
+            buffer.resize(sizeof(VOLUME_DISK_EXTENTS) + diskExtents->NumberOfDiskExtents * sizeof(DISK_EXTENT));
+        }
+        if (diskExtents->NumberOfDiskExtents == 0)
+        {
+            throw std::runtime_error("Volume reports no disk extents.");
+        }
+
+        VolumeInfo info;
+        info.ClusterSize = sectorsPerCluster * bytesPerSector;
+        info.BytesPerSector = bytesPerSector;
+        info.PartitionStartOffset = diskExtents->Extents[0].StartingOffset;
+        info.Extents.assign(diskExtents->Extents, diskExtents->Extents + diskExtents->NumberOfDiskExtents);
+        info.Volume = std::move(volumeHandle);
+        return info;
     }
+};
+
+const VolumeInfo &GetVolumeInfo(const fs::path &filepath)
+{
+    return VolumeCache::get().lookup(filepath);
+}
 
-    std::wstring volumeDevicePathW = L"\\\\.\\";
-    volumeDevicePathW += volumePathW.substr(0, 2); // \\.\<drive>:
-    HandleWrapper volumeHandle(CreateFileW(volumeDevicePathW.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL));
-    if (volumeHandle.handle == INVALID_HANDLE_VALUE)
+DiskLocation VolumeInfo::ToDisk(LONGLONG volumeOffset) const
+{
+    if (Extents.size() == 1)
     {
-        throw std::system_error(GetLastError(), std::system_category(), "Failed to open volume");
+        return {Extents[0].DiskNumber, Extents[0].StartingOffset.QuadPart + volumeOffset};
     }
 
-    VOLUME_DISK_EXTENTS diskExtents;
+    // Let the volume manager resolve striped and mirrored layouts; the first copy is reported.
+    VOLUME_LOGICAL_OFFSET logical;
+    logical.LogicalOffset = volumeOffset;
+    std::vector<char> buffer(sizeof(VOLUME_PHYSICAL_OFFSETS) + Extents.size() * sizeof(VOLUME_PHYSICAL_OFFSET));
+    VOLUME_PHYSICAL_OFFSETS *physical = reinterpret_cast<VOLUME_PHYSICAL_OFFSETS *>(buffer.data());
     DWORD bytesReturned;
-    if (!DeviceIoControl(volumeHandle, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0, &diskExtents, sizeof(diskExtents), &bytesReturned, NULL))
+    if (DeviceIoControl(*Volume, IOCTL_VOLUME_LOGICAL_TO_PHYSICAL, &logical, sizeof(logical), physical, static_cast<DWORD>(buffer.size()), &bytesReturned, NULL) &&
+        physical->NumberOfPhysicalOffsets > 0)
     {
-        throw std::system_error(GetLastError(), std::system_category(), "IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS failed");
+        return {physical->PhysicalOffset[0].DiskNumber, physical->PhysicalOffset[0].Offset};
     }
 
-    return {
-        sectorsPerCluster * bytesPerSector,
-        bytesPerSector,
-        diskExtents.Extents[0].StartingOffset};
+    // Fall back to a simple spanned layout: extents are concatenated in order.
+    LONGLONG remaining = volumeOffset;
+    for (const DISK_EXTENT &extent : Extents)
+    {
+        if (remaining < extent.ExtentLength.QuadPart)
+            return {extent.DiskNumber, extent.StartingOffset.QuadPart + remaining};
+        remaining -= extent.ExtentLength.QuadPart;
+    }
+    throw std::runtime_error("Volume offset lies beyond the last disk extent.");
+}
+
+std::vector<DiskPiece> VolumeInfo::ToDiskPieces(LONGLONG volumeOffset, LONGLONG length) const
+{
+    std::vector<DiskPiece> pieces;
+    const LONGLONG end = volumeOffset + length;
+    const LONGLONG sector = BytesPerSector;
+    while (volumeOffset < end)
+    {
+        const DiskLocation location = ToDisk(volumeOffset);
+        const LONGLONG remaining = end - volumeOffset;
+        if (Extents.size() == 1)
+        {
+            pieces.push_back({volumeOffset, remaining, location});
+            break;
+        }
+
+        // A piece of len bytes is contiguous when its last sector sits where the first one predicts.
+        // Spanned and striped layouts are linear within each piece, so gallop to the first length
+        // that breaks this and bisect back to the last one that holds.
+        auto contiguous = [&](LONGLONG len)
+        {
+            const DiskLocation last = ToDisk(volumeOffset + len - sector);
+            return last.DiskNumber == location.DiskNumber && last.Offset == location.Offset + len - sector;
+        };
+        LONGLONG good = std::min(sector, remaining);
+        LONGLONG bad = 0;
+        while (bad == 0 && good < remaining)
+        {
+            const LONGLONG len = std::min(good * 2, remaining);
+            (contiguous(len) ? good : bad) = len;
+        }
+        while (bad - good > sector)
+        {
+            const LONGLONG mid = good + std::max(sector, (bad - good) / 2 / sector * sector);
+            (contiguous(mid) ? good : bad) = mid;
+        }
+        pieces.push_back({volumeOffset, good, location});
+        volumeOffset += good;
+    }
+    return pieces;
+}
+
+std::string PhysicalDriveName(DWORD diskNumber)
+{
+    return "\\\\.\\PhysicalDrive" + std::to_string(diskNumber);
+}
+
+// Reads the complete run list of a file. The output buffer holds a page of runs; when the file
+// has more, the call fails with ERROR_MORE_DATA and the next page starts at the last NextVcn.
+std::vector<ClusterRun> GetClusterRuns(HANDLE hFile)
+{
+    constexpr size_t pageBytes = 64 * 1024;
+    std::vector<char> outputBuffer(pageBytes);
+    RETRIEVAL_POINTERS_BUFFER *retrievalPointers = reinterpret_cast<RETRIEVAL_POINTERS_BUFFER *>(outputBuffer.data());
+
+    std::vector<ClusterRun> runs;
+    STARTING_VCN_INPUT_BUFFER inputBuffer;
+    inputBuffer.StartingVcn.QuadPart = 0;
+    for (;;)
+    {
+        DWORD bytesReturned = 0;
+        METRIC_INC("offset2lba.retrieval_pointers");
+        BOOL ok = DeviceIoControl(hFile, FSCTL_GET_RETRIEVAL_POINTERS, &inputBuffer, sizeof(inputBuffer), retrievalPointers,
+                                  static_cast<DWORD>(outputBuffer.size()), &bytesReturned, NULL);
+        DWORD error = ok ? ERROR_SUCCESS : GetLastError();
+        if (error == ERROR_HANDLE_EOF)
+        {
+            break; // no (more) clusters: empty or MFT-resident file
+        }
+        if (error != ERROR_SUCCESS && error != ERROR_MORE_DATA)
+        {
+            throw std::system_error(error, std::system_category(), "FSCTL_GET_RETRIEVAL_POINTERS failed");
+        }
+
+        LONGLONG vcn = retrievalPointers->StartingVcn.QuadPart;
+        for (DWORD i = 0; i < retrievalPointers->ExtentCount; ++i)
+        {
+            runs.push_back({vcn, retrievalPointers->Extents[i].NextVcn.QuadPart, retrievalPointers->Extents[i].Lcn.QuadPart});
+            vcn = retrievalPointers->Extents[i].NextVcn.QuadPart;
+        }
+        if (error == ERROR_SUCCESS || retrievalPointers->ExtentCount == 0)
+        {
+            break;
+        }
+        inputBuffer.StartingVcn.QuadPart = vcn;
+    }
+    return runs;
 }
 
 LARGE_INTEGER FindLcnFromVcn(HANDLE hFile, LONGLONG vcn)
@@ -134,7 +449,10 @@ LARGE_INTEGER FindLcnFromVcn(HANDLE hFile, LONGLONG vcn)
     RETRIEVAL_POINTERS_BUFFER *retrievalPointers = reinterpret_cast<RETRIEVAL_POINTERS_BUFFER *>(outputBuffer.data());
     DWORD bytesReturned;
 
-    if (!DeviceIoControl(hFile, FSCTL_GET_RETRIEVAL_POINTERS, &inputBuffer, sizeof(inputBuffer), retrievalPointers, outputBuffer.size(), &bytesReturned, NULL))
+    // ERROR_MORE_DATA only means later runs did not fit; the first run already covers vcn.
+    METRIC_INC("offset2lba.retrieval_pointers");
+    if (!DeviceIoControl(hFile, FSCTL_GET_RETRIEVAL_POINTERS, &inputBuffer, sizeof(inputBuffer), retrievalPointers, static_cast<DWORD>(outputBuffer.size()), &bytesReturned, NULL) &&
+        GetLastError() != ERROR_MORE_DATA)
     {
         throw std::system_error(GetLastError(), std::system_category(), "FSCTL_GET_RETRIEVAL_POINTERS failed");
     }
@@ -151,8 +469,13 @@ LARGE_INTEGER FindLcnFromVcn(HANDLE hFile, LONGLONG vcn)
         {
             // This is the extent that contains our VCN.
             // The LCN of the extent + the offset from the start of the extent's VCNs.
+            LONGLONG runStart = i == 0 ? retrievalPointers->StartingVcn.QuadPart : retrievalPointers->Extents[i - 1].NextVcn.QuadPart;
+            if (retrievalPointers->Extents[i].Lcn.QuadPart == -1)
+            {
+                throw std::runtime_error("Offset lies in a sparse range of the file.");
+            }
             LARGE_INTEGER lcn;
-            lcn.QuadPart = retrievalPointers->Extents[i].Lcn.QuadPart + (vcn - retrievalPointers->StartingVcn.QuadPart);
+            lcn.QuadPart = retrievalPointers->Extents[i].Lcn.QuadPart + (vcn - runStart);
             return lcn;
         }
     }
@@ -177,7 +500,8 @@ void CalculateAndPrintLbaInfo(fs::path &filepath, off_t offset, const VolumeInfo
 {
     LONGLONG offsetInCluster = offset % volInfo.ClusterSize;
     LONGLONG filePhysicalOffset = (lcn.QuadPart * volInfo.ClusterSize) + offsetInCluster;
-    LONGLONG diskAbsoluteOffset = volInfo.PartitionStartOffset.QuadPart + filePhysicalOffset;
+    DiskLocation location = volInfo.ToDisk(filePhysicalOffset);
+    LONGLONG diskAbsoluteOffset = location.Offset;
     LONGLONG absoluteLba = diskAbsoluteOffset / volInfo.BytesPerSector;
 
     LOG_INFO("File: {}", to_ansi(filepath).c_str());
@@ -186,6 +510,11 @@ void CalculateAndPrintLbaInfo(fs::path &filepath, off_t offset, const VolumeInfo
     LOG_INFO("File System Cluster Size: {} bytes", volInfo.ClusterSize);
     LOG_INFO("Disk Sector Size: {} bytes", volInfo.BytesPerSector);
     LOG_INFO("Partition Start Offset: {} (lba)", volInfo.PartitionStartOffset.QuadPart / volInfo.BytesPerSector);
+    if (volInfo.Extents.size() > 1)
+    {
+        LOG_INFO("Volume Disk Extents: {}", volInfo.Extents.size());
+    }
+    LOG_INFO("Physical Drive: \\\\.\\PhysicalDrive{}", location.DiskNumber);
     LOG_INFO("Absolute Offset on Disk: {} (bytes)", diskAbsoluteOffset);
     LOG_INFO("Absolute LBA on Disk: {}", absoluteLba);
 }
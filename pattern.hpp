@@ -0,0 +1,273 @@
+#ifndef PATTERN_HPP
+#define PATTERN_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PATTERN_X86_CRC 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace crc32c_detail
+{
+    // Slicing-by-8 tables for the Castagnoli polynomial (reflected 0x82F63B78).
+    inline const std::array<std::array<uint32_t, 256>, 8> &tables()
+    {
+        static const auto t = []
+        {
+            std::array<std::array<uint32_t, 256>, 8> tab{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+                tab[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; ++i)
+                for (int s = 1; s < 8; ++s)
+                    tab[s][i] = (tab[s - 1][i] >> 8) ^ tab[0][tab[s - 1][i] & 0xFF];
+            return tab;
+        }();
+        return t;
+    }
+
+    inline uint32_t software(uint32_t crc, const unsigned char *p, size_t n)
+    {
+        const auto &t = tables();
+        while (n >= 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            v ^= crc;
+            crc = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+                  t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+            p += 8;
+            n -= 8;
+        }
+        while (n--)
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+        return crc;
+    }
+
+#if defined(PATTERN_X86_CRC)
+#if defined(__GNUC__)
+    __attribute__((target("sse4.2")))
+#endif
+    inline uint32_t
+    hardware(uint32_t crc, const unsigned char *p, size_t n)
+    {
+        uint64_t c = crc;
+        while (n >= 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            c = _mm_crc32_u64(c, v);
+            p += 8;
+            n -= 8;
+        }
+        uint32_t c32 = static_cast<uint32_t>(c);
+        while (n--)
+            c32 = _mm_crc32_u8(c32, *p++);
+        return c32;
+    }
+
+    inline bool has_hardware()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        static const bool sse42 = (info[2] & (1 << 20)) != 0;
+#else
+        static const bool sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+        return sse42;
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    inline uint32_t hardware(uint32_t crc, const unsigned char *p, size_t n)
+    {
+        while (n >= 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            crc = __crc32cd(crc, v);
+            p += 8;
+            n -= 8;
+        }
+        while (n--)
+            crc = __crc32cb(crc, *p++);
+        return crc;
+    }
+
+    inline bool has_hardware() { return true; }
+#endif
+} // namespace crc32c_detail
+
+// CRC32C (Castagnoli) of data, continuing from crc. Uses the SSE4.2 / ARMv8 CRC instructions when
+// the CPU has them and a slicing-by-8 table otherwise.
+inline uint32_t crc32c(const void *data, size_t size, uint32_t crc = 0)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#if defined(PATTERN_X86_CRC) || defined(__ARM_FEATURE_CRC32)
+    if (crc32c_detail::has_hardware())
+        return ~crc32c_detail::hardware(crc, p, size);
+#endif
+    return ~crc32c_detail::software(crc, p, size);
+}
+
+enum class PatternKind
+{
+    Fixed,  // every byte the same
+    Lba,    // stamped sectors, payload of incrementing words
+    Random, // stamped sectors, payload from a seeded generator
+};
+
+// Header at the start of every sector written with PatternKind::Lba or Random. crc covers the
+// whole sector with the crc field itself set to zero.
+struct SectorStamp
+{
+    static constexpr uint64_t magic_value = 0x4E52544150554C21ULL; // "!LUPATRN"
+
+    uint64_t magic;
+    uint64_t lba;
+    uint64_t seed;
+    uint32_t sector_size;
+    uint32_t crc;
+};
+static_assert(sizeof(SectorStamp) == 32);
+
+// Generates and checks sector-granular test data. Every sector depends only on its LBA and the
+// seed, so requests can be filled and verified in any order and at any offset.
+class DataPattern
+{
+public:
+    DataPattern(PatternKind kind, unsigned int sector_size, uint64_t seed = 0, unsigned char fill = 'A')
+        : kind_(kind), sector_size_(sector_size), seed_(seed), fill_(fill)
+    {
+    }
+
+    static std::optional<PatternKind> parse(std::string_view name)
+    {
+        if (name == "fixed")
+            return PatternKind::Fixed;
+        if (name == "lba")
+            return PatternKind::Lba;
+        if (name == "random")
+            return PatternKind::Random;
+        return std::nullopt;
+    }
+
+    PatternKind kind() const { return kind_; }
+
+    // Fills len bytes (a multiple of the sector size) for the sectors starting at first_lba.
+    void fill(char *buf, size_t len, uint64_t first_lba) const
+    {
+        if (kind_ == PatternKind::Fixed)
+        {
+            std::memset(buf, fill_, len);
+            return;
+        }
+        for (size_t off = 0; off + sector_size_ <= len; off += sector_size_)
+            fill_sector(buf + off, first_lba + off / sector_size_);
+    }
+
+    // Checks every sector of buf and calls on_mismatch(lba, reason) for each bad one. Returns the
+    // number of bad sectors.
+    size_t verify(const char *buf, size_t len, uint64_t first_lba,
+                  const std::function<void(uint64_t lba, const char *reason)> &on_mismatch) const
+    {
+        size_t bad = 0;
+        for (size_t off = 0; off + sector_size_ <= len; off += sector_size_)
+        {
+            const uint64_t lba = first_lba + off / sector_size_;
+            if (const char *reason = check_sector(buf + off, lba))
+            {
+                ++bad;
+                on_mismatch(lba, reason);
+            }
+        }
+        return bad;
+    }
+
+private:
+    PatternKind kind_;
+    unsigned int sector_size_;
+    uint64_t seed_;
+    unsigned char fill_;
+
+    // splitmix64: a counter-based generator, so any word of any sector can be produced
+    // independently and the fill loop vectorizes.
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    void fill_sector(char *sector, uint64_t lba) const
+    {
+        const size_t words = (sector_size_ - sizeof(SectorStamp)) / sizeof(uint64_t);
+        uint64_t *payload = reinterpret_cast<uint64_t *>(sector + sizeof(SectorStamp));
+        if (kind_ == PatternKind::Lba)
+        {
+            const uint64_t base = lba << 16;
+            for (size_t i = 0; i < words; ++i)
+                payload[i] = base + i;
+        }
+        else
+        {
+            const uint64_t key = mix(seed_ ^ mix(lba)) * words;
+            for (size_t i = 0; i < words; ++i)
+                payload[i] = mix(key + i);
+        }
+
+        SectorStamp stamp{SectorStamp::magic_value, lba, seed_, sector_size_, 0};
+        std::memcpy(sector, &stamp, sizeof(stamp));
+        stamp.crc = crc32c(sector, sector_size_);
+        std::memcpy(sector + offsetof(SectorStamp, crc), &stamp.crc, sizeof(stamp.crc));
+    }
+
+    // Returns nullptr for a good sector, otherwise what is wrong with it.
+    const char *check_sector(const char *sector, uint64_t lba) const
+    {
+        if (kind_ == PatternKind::Fixed)
+        {
+            for (size_t i = 0; i < sector_size_; ++i)
+                if (static_cast<unsigned char>(sector[i]) != fill_)
+                    return "data mismatch";
+            return nullptr;
+        }
+
+        SectorStamp stamp;
+        std::memcpy(&stamp, sector, sizeof(stamp));
+        if (stamp.magic != SectorStamp::magic_value)
+            return "no stamp";
+        if (stamp.lba != lba)
+            return "stamp from another LBA (misdirected write)";
+        if (stamp.seed != seed_ || stamp.sector_size != sector_size_)
+            return "stamp from another run";
+        // CRC over the sector with its crc field zeroed: crc(prefix) -> zeros -> rest.
+        const uint32_t zero = 0;
+        const size_t crc_at = offsetof(SectorStamp, crc);
+        uint32_t crc = crc32c(sector, crc_at);
+        crc = crc32c(&zero, sizeof(zero), crc);
+        crc = crc32c(sector + crc_at + sizeof(zero), sector_size_ - crc_at - sizeof(zero), crc);
+        if (crc != stamp.crc)
+            return "CRC mismatch";
+        return nullptr;
+    }
+};
+
+#endif // PATTERN_HPP
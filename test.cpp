@@ -1,7 +1,18 @@
 #include "argparser.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "compare.hpp"
+#include "blockio.hpp"
+#include "offset2lba.hpp"
 #include <thread>
 #include <locale>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <vector>
+
 
 // Use the argparse namespace
 using namespace argparse;
@@ -14,45 +25,301 @@ std::string formatWithCommas(unsigned long number)
     return number_str;
 }
 
+// Per-worker results of the copy and compare test.
+struct WorkerStats
+{
+    unsigned long long copied = 0;   // bytes written to the destination
+    unsigned long long compared = 0; // bytes read back and checked
+    unsigned long long passes = 0;   // complete copy + compare rounds
+    unsigned long long mismatches = 0;
+    double copy_seconds = 0;    // time spent in each phase, so each rate is against its own time
+    double compare_seconds = 0;
+};
+
+struct CopyTest
+{
+    fs::path source;
+    unsigned long long offset = 0; // first source byte to copy
+    unsigned long long length = 0; // bytes copied per pass
+    size_t chunk = 0;
+    size_t sector = 512; // granularity of mismatch reports
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> failed{false};
+};
+
+static double mb_per_sec(unsigned long long bytes, double seconds)
+{
+    return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0;
+}
+
+// Logs the first differing byte of a chunk and the disk LBA of every differing sector in it.
+static void report_mismatch(const CopyTest &test, const fs::path &target, int id, unsigned long long chunkOffset,
+                            const char *src, const char *dst, size_t ns, size_t nd, size_t first)
+{
+    std::vector<unsigned long long> offsets;
+    size_t bad = mismatching_sectors(src, dst, std::min(ns, nd), test.sector, [&](size_t sector)
+                                     { offsets.push_back(chunkOffset + sector * test.sector); });
+    if (nd < ns)
+    {
+        // The destination came back short: every missing sector counts as bad.
+        for (size_t pos = nd / test.sector * test.sector; pos < ns; pos += test.sector)
+        {
+            if (offsets.empty() || offsets.back() < chunkOffset + pos)
+            {
+                offsets.push_back(chunkOffset + pos);
+                ++bad;
+            }
+        }
+    }
+    LOG_ERROR("[{}] Mismatch in {}: first differing byte at offset {:#x}, {} bad {}-byte sector(s) in this chunk", id,
+              target.string(), chunkOffset + first, bad, test.sector);
+
+    constexpr size_t maxListed = 32;
+    if (offsets.size() > maxListed)
+        offsets.resize(maxListed);
+    try
+    {
+        get_lba_batch(target, offsets, [&](const LbaResult &r)
+                      {
+            if (r.mapped)
+                LOG_ERROR("[{}]   offset {:#x} -> LBA {} on {}", id, r.offset, r.absolute_lba, r.disk);
+            else
+                LOG_ERROR("[{}]   offset {:#x} -> not mapped", id, r.offset); });
+    }
+    catch (const std::exception &e)
+    {
+        LOG_WARNING("[{}] Could not translate mismatch offsets to LBAs: {}", id, e.what());
+    }
+}
+
+// One worker: copies the source into its own file under dest, reads both back and compares them,
+// and repeats until the deadline. The next chunk is always being read on a helper task while the
+// current one is written or compared, so the disks are kept busy while the CPU works.
+static void copy_compare_worker(CopyTest &test, const fs::path &dest, int id, WorkerStats &stats)
+{
+    const fs::path target = dest / ("ccmp_" + std::to_string(id) + ".bin");
+    auto expired = [&]
+    { return test.failed || std::chrono::steady_clock::now() >= test.deadline; };
+    auto since = [](std::chrono::steady_clock::time_point t)
+    { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count(); };
+
+    // Page-aligned buffers, read and written with positional I/O: the helper task and the writer
+    // never share a file position, and no stream buffer sits in between.
+    blockio::AlignedBuffer src[2] = {blockio::AlignedBuffer(test.chunk), blockio::AlignedBuffer(test.chunk)};
+    blockio::AlignedBuffer dst[2] = {blockio::AlignedBuffer(test.chunk), blockio::AlignedBuffer(test.chunk)};
+    auto read_chunk = [](native_handle_t h, char *buf, size_t want, unsigned long long offset)
+    {
+        METRIC_TIMER("test.read_ns");
+        return blockio::read_full_at(h, buf, want, offset);
+    };
+    // Unbuffered reads must cover whole aligned blocks, so the block the file ends in is read
+    // in full and the count cut to what was asked for.
+    const size_t align = blockio::page_size();
+    auto read_direct = [align](native_handle_t h, char *buf, size_t want, unsigned long long offset)
+    {
+        METRIC_TIMER("test.read_ns");
+        const size_t len = (want + align - 1) / align * align;
+        size_t done = 0;
+        while (done < len)
+        {
+            size_t n = blockio::read_at(h, buf + done, len - done, offset + done);
+            done += n;
+            if (n == 0 || done % align)
+                break; // end of file
+        }
+        return std::min(done, want);
+    };
+    bool warnedCached = false;
+
+    try
+    {
+        blockio::Handle in = blockio::open_file(test.source, blockio::read_only);
+        while (!expired())
+        {
+            auto phase = std::chrono::steady_clock::now();
+            blockio::Handle out = blockio::open_file(target, blockio::create);
+
+            // Copy: write chunk n while chunk n + 1 is being read.
+            unsigned long long copied = 0;
+            int cur = 0;
+            auto pending = std::async(std::launch::async, read_chunk, in.get(), src[cur].data(), std::min<unsigned long long>(test.chunk, test.length), test.offset);
+            while (true)
+            {
+                size_t n = pending.get();
+                if (n == 0)
+                    break;
+                const bool more = copied + n < test.length && !expired();
+                if (more)
+                    pending = std::async(std::launch::async, read_chunk, in.get(), src[cur ^ 1].data(), std::min<unsigned long long>(test.chunk, test.length - copied - n),
+                                         test.offset + copied + n);
+                {
+                    METRIC_TIMER("test.write_ns");
+                    blockio::write_full_at(out, src[cur].data(), n, copied);
+                }
+                copied += n;
+                stats.copied += n;
+                cur ^= 1;
+                if (!more)
+                {
+                    if (pending.valid())
+                        pending.get();
+                    break;
+                }
+            }
+            if (copied < test.length)
+            {
+                stats.copy_seconds += since(phase);
+                break; // deadline hit in the middle of a pass
+            }
+
+            // The copy is read back from the disk, not from the cache, or on-disk corruption would
+            // never show: unbuffered where the file system allows it, else after writing it out
+            // and dropping its cached pages.
+            blockio::flush(out);
+            stats.copy_seconds += since(phase);
+            phase = std::chrono::steady_clock::now();
+            blockio::Handle check;
+            bool direct = test.chunk % align == 0;
+            if (direct)
+            {
+                try
+                {
+                    check = blockio::open_file(target, blockio::read_only | blockio::direct);
+                }
+                catch (const std::system_error &)
+                {
+                    direct = false;
+                }
+            }
+            if (!direct)
+            {
+                check = blockio::open_file(target, blockio::read_only);
+                if (!blockio::drop_cache(check) && !warnedCached)
+                {
+                    LOG_WARNING("[{}] {} is read back through the cache; on-disk corruption may go unnoticed", id, target.string());
+                    warnedCached = true;
+                }
+            }
+
+            // Compare: check chunk n while chunk n + 1 of both files is being read.
+            auto read_pair = [&](int slot, size_t want, unsigned long long at)
+            {
+                size_t nd = direct ? read_direct(check, dst[slot].data(), want, at) : read_chunk(check, dst[slot].data(), want, at);
+                return std::make_pair(read_chunk(in, src[slot].data(), want, test.offset + at), nd);
+            };
+            unsigned long long compared = 0;
+            cur = 0;
+            auto pendingPair = std::async(std::launch::async, read_pair, cur, std::min<unsigned long long>(test.chunk, test.length), 0ULL);
+            while (true)
+            {
+                auto [ns, nd] = pendingPair.get();
+                if (ns == 0)
+                    break;
+                const bool more = compared + ns < test.length && !expired();
+                if (more)
+                    pendingPair = std::async(std::launch::async, read_pair, cur ^ 1, std::min<unsigned long long>(test.chunk, test.length - compared - ns), compared + ns);
+                const size_t common = std::min(ns, nd);
+                size_t at;
+                {
+                    METRIC_TIMER("test.compare_ns");
+                    at = first_mismatch(src[cur].data(), dst[cur].data(), common);
+                }
+                if (at < common || ns != nd)
+                {
+                    report_mismatch(test, target, id, compared, src[cur].data(), dst[cur].data(), ns, nd, at);
+                    ++stats.mismatches;
+                    test.failed = true;
+                }
+                compared += ns;
+                stats.compared += ns;
+                cur ^= 1;
+                if (!more)
+                {
+                    if (pendingPair.valid())
+                        pendingPair.get();
+                    break;
+                }
+            }
+            stats.compare_seconds += since(phase);
+            if (compared == test.length)
+                ++stats.passes;
+        }
+    }
+    catch (const std::system_error &e)
+    {
+        LOG_ERROR("[{}] {}", id, e.what());
+        test.failed = true;
+    }
+
+    if (stats.mismatches == 0)
+    {
+        std::error_code ec;
+        fs::remove(target, ec);
+    }
+}
+
+// Names are checked at compile time; see argparse::Args.
+inline constexpr Spec copy_options[] = {
+    positional("command", "Command to excute.", true),
+    positional("source", "Source file or device path.", true),
+    option("-time", "-t", "test time (unit: min)", false, "2"),
+    option("--dest", "-d", "destination directory path", true),
+    option("--thread", "-T", "thread count", false, "5"),
+    option("--offset", "-o", "Start offset in hex for test", false, "0x1000"), // New option for hex test
+    option("--chunk", "-c", "copy/compare chunk size (unit: KiB)", false, "4096"),
+    option("--sector", "-s", "sector size used for mismatch reports (unit: bytes)", false, "512"),
+    flag("--test", "", "for test. used time unit as minute"),
+    option("--log", "-L", "log level", false, "INFO"),
+    flag("--log-async", "", "write log records from a background thread"),
+    option("--metrics", "", "log read/write/compare timings at exit: step or json"),
+    option("--metrics-interval", "", "seconds between metric dumps (0: only at exit)", false, "0"),
+};
+
 int main(int argc, char *argv[])
 {
     // std::locale::global(std::locale(""));
 
-    ArgParser parser("Copy and Compare test. ver. 0.1.0");
-    parser.add_positional("command", "Command to excute.", true);
-    parser.add_positional("source", "Source file or device path.", true);
-    parser.add_option("-time", "-t", "test time (unit: min)", false, "2");
-    parser.add_option("--dest", "-d", "destination directory path", true);
-    parser.add_option("--thread", "-T", "thread count", false, "5");
-    parser.add_option("--offset", "-o", "Start offset in hex for test", false, "0x1000"); // New option for hex test
-    parser.add_flag("--test", "", "for test. used time unit as minute");
-    parser.add_option("--log", "-L", "log level", false, "INFO");
-    if (!parser.parse(argc, argv))
+    Args<copy_options> args("Copy and Compare test. ver. 0.2.0");
+    if (!args.parse(argc, argv))
     {
         return 1;
     }
 
-    auto cmd = parser.get_positional("command").value();
-    auto source = parser.get_positional("source").value();
-    std::vector<std::string> destlist = parser.get_list("dest").value_or(std::vector<std::string>{});
+    auto cmd = args.get<"command", std::string>().value();
+    auto source = args.get<"source", std::string>().value();
+    std::vector<std::string> destlist = args.get_list<"dest">().value_or(std::vector<std::string>{});
 
     // Use new get<T> for type conversion
-    auto multithread = parser.get<int>("thread").value_or(1);
-    auto test = parser.is_set("test");
-    auto nTestTime = parser.get<int>("time").value_or(1) * ((test) ? 1 : 60);
+    auto multithread = args.get<"thread", int>().value_or(1);
+    auto test = args.is_set<"test">();
+    auto nTestTime = args.get<"time", int>().value_or(1) * ((test) ? 1 : 60);
 
     // Test hex parsing
-    auto offset = parser.get<long>("offset").value_or(0);
+    auto offset = args.get<"offset", long>().value_or(0);
 
-    auto log_level = parser.get("log").value();
+    auto log_level = args.get<"log", std::string>().value();
     Logger::get().set_level(log_level);
+    if (args.is_set<"log-async">())
+        Logger::get().start_async();
+    std::optional<metrics::Reporter> reporter;
+    if (auto name = args.get<"metrics", std::string>())
+    {
+        auto format = metrics::parse_format(*name);
+        auto interval = args.get<"metrics-interval", unsigned int>();
+        if (!format || !interval)
+        {
+            LOG_FATAL("--metrics takes step or json, --metrics-interval a number of seconds.");
+            return 1;
+        }
+        reporter.emplace(*format, std::chrono::seconds(*interval));
+    }
 
     LOG_INFO("Source: {:>10}", source);
-    LOG_INFO("Destination: {}", parser.get("dest").value());
+    LOG_INFO("Destination: {}", args.get<"dest">().value());
     LOG_INFO("Thread count: %d", multithread);
     LOG_INFO("Offset: {:#x}", offset); // Log the parsed hex value
     LOG_INFO("Test mode: {} {}", test, test ? "enabled" : "disabled");
-    LOG_INFO("Test time: %s minutes", 4, formatWithCommas(nTestTime));
+    LOG_INFO("Test time: %s minutes", formatWithCommas(nTestTime));
     printf("Test time: {%s} minutes\n", formatWithCommas(nTestTime).c_str());
 
     // printf-style format (명시적 printf API 테스트)
@@ -62,10 +329,72 @@ int main(int argc, char *argv[])
     for (const auto &dest : destlist)
     {
         LOG_DEBUG("Destination path: {}", dest);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
+    if (cmd != "copy")
+    {
+        LOG_FATAL("Unknown command: {}. Use 'copy' to run the copy and compare test.", cmd);
+        return 1;
+    }
+    if (destlist.empty() || multithread < 1)
+    {
+        LOG_FATAL("Need at least one destination and one thread.");
+        return 1;
+    }
+
+    CopyTest copyTest;
+    copyTest.source = source;
+    copyTest.offset = static_cast<unsigned long long>(offset);
+    copyTest.chunk = static_cast<size_t>(args.get<"chunk", int>().value_or(4096)) * 1024;
+    copyTest.sector = static_cast<size_t>(args.get<"sector", int>().value_or(512));
+    if (copyTest.chunk == 0 || copyTest.sector == 0)
+    {
+        LOG_FATAL("Chunk and sector size must be positive.");
+        return 1;
+    }
+    LOG_DEBUG("Compare kernel: {}", compare_kernel());
+    try
+    {
+        // Works for block devices too, where the size comes from the driver.
+        blockio::Handle in = blockio::open_file(copyTest.source, blockio::read_only);
+        unsigned long long size = blockio::query_geometry(in, source).size;
+        if (size <= copyTest.offset)
+        {
+            LOG_FATAL("Offset {:#x} is beyond the end of the source ({} bytes).", copyTest.offset, size);
+            return 1;
+        }
+        copyTest.length = size - copyTest.offset;
+    }
+    catch (const std::system_error &e)
+    {
+        LOG_FATAL("{}", e.what());
+        return 1;
+    }
+    copyTest.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(nTestTime);
+
     LOG_INFO("Starting copy and compare test...");
+    std::vector<WorkerStats> stats(multithread);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < multithread; ++i)
+        workers.emplace_back(copy_compare_worker, std::ref(copyTest), fs::path(destlist[i % destlist.size()]), i, std::ref(stats[i]));
+    for (auto &w : workers)
+        w.join();
+
+    // Workers run side by side, so the totals are the sums of their rates.
+    WorkerStats total;
+    double copyRate = 0, compareRate = 0;
+    for (int i = 0; i < multithread; ++i)
+    {
+        const WorkerStats &s = stats[i];
+        LOG_INFO("[{}] {} passes, copy {:.1f} MB/s, compare {:.1f} MB/s, {} mismatches", i, s.passes,
+                 mb_per_sec(s.copied, s.copy_seconds), mb_per_sec(s.compared, s.compare_seconds), s.mismatches);
+        copyRate += mb_per_sec(s.copied, s.copy_seconds);
+        compareRate += mb_per_sec(s.compared, s.compare_seconds);
+        total.passes += s.passes;
+        total.mismatches += s.mismatches;
+    }
+    LOG_INFO("Total: {} passes, copy {:.1f} MB/s, compare {:.1f} MB/s, {} mismatches", total.passes, copyRate, compareRate,
+             total.mismatches);
 
     LOG_INFO("Copy and compare test completed.");
-    return 0;
+    return copyTest.failed ? 1 : 0;
 }